@@ -0,0 +1,84 @@
+#define CTX_IMPLEMENTATION
+#include "ctx.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Memtable-like load: every thread inserts random keys, then the whole table is flushed
+static const size_t KEYS_PER_THREAD = 200000;
+static const size_t ROUNDS          = 3;
+
+static uint64_t next_key (uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return *state;
+}
+
+template <typename Insert>
+static double run (size_t threads, Insert insert) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now ();
+
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back ([t, &insert] () {
+            uint64_t state = 0x9E3779B97F4A7C15ull * (t + 1);
+
+            for (size_t i = 0; i < KEYS_PER_THREAD; i++) {
+                uint64_t key = next_key (&state);
+                insert (key, (void*)(uintptr_t)key);
+            }
+        });
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join ();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+
+    return (double)(threads * KEYS_PER_THREAD) / elapsed.count () / 1e6;
+}
+
+int main (int argc, char** argv) {
+    size_t threads = argc > 1 ? (size_t)strtoul (argv[1], NULL, 10) : std::thread::hardware_concurrency ();
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    // Nodes average under 40 bytes with quarter probability tower heights
+    Context arena = new_context (threads * KEYS_PER_THREAD * 64 + 4 KB);
+
+    CTX_LOG ("[BENCH]: %zu threads x %zu inserts, %zu rounds\n", threads, KEYS_PER_THREAD, ROUNDS);
+
+    for (size_t round = 0; round < ROUNDS; round++) {
+        ContextSkipList list = context_skiplist (&arena);
+
+        double skiplist = run (threads, [&list] (uint64_t key, void* value) {
+            context_skiplist_insert (&list, key, value);
+        });
+
+        std::map<uint64_t, void*> map;
+        std::mutex lock;
+
+        double locked_map = run (threads, [&map, &lock] (uint64_t key, void* value) {
+            std::lock_guard<std::mutex> guard (lock);
+            map[key] = value;
+        });
+
+        CTX_LOG ("[BENCH]: round %zu skip list %6.2f Mops/s (%zu keys, %zu bytes), std::map + mutex %6.2f Mops/s (%zu keys)\n",
+                 round, skiplist, list.count, arena.location, locked_map, map.size ());
+
+        // Flushing the table releases every node at once
+        context_clear (&arena);
+    }
+
+    context_free (&arena);
+
+    return 0;
+}
@@ -20,6 +20,8 @@
 //          call context_tclear () at the end of every frame.
 //        * When you use a context, all library code and logs will refer to it as
 //          a "static context"
+//        * context_decommit needs madvise, strict ISO modes (EG. -std=c11) hide it on
+//          glibc unless _DEFAULT_SOURCE is defined before any include
 //
 //    CONFIGURATION:
 //        #define CTX_IMPLEMENTATION or #define CTX_IMPL
@@ -46,15 +48,157 @@
 //        #define CTX_NO_STR
 //            Disables the string helper functions.
 //
+//        #define CTX_NO_TYPED_HELPERS
+//            Disables the ctx_new, ctx_new_array and ctx_new_zeroed macros.
+//
+//        #define CTX_NO_CLEANUP
+//            Disables the cleanup registry (context_defer), clearing, rewinding and
+//            freeing a context will then only reset offsets.
+//
+//        #define CTX_NO_COROUTINES
+//            Disables the C++20 coroutine frame helpers (ContextPromise).
+//
+//        #define CTX_NO_GC
+//            Disables the semi-space copying collector (context_gc_collect).
+//
+//        #define CTX_NO_HANDLES
+//            Disables the generational handle tables (ContextHandleTable).
+//
+//        #define CTX_HANDLE_REWINDS X
+//            Number of rewind targets each context remembers so handles survive
+//            rewinds that stay above their object, defaults to 4. Handles older than
+//            the remembered rewinds are treated as stale.
+//
+//        #define CTX_NO_BTREE
+//            Disables the arena allocated B+tree (ContextBTree).
+//
+//        #define CTX_BTREE_NODE_LINES X
+//            Cache lines per B+tree node, defaults to 4 (15 keys per node with 64
+//            byte lines).
+//
+//        #define CTX_NO_SKIPLIST
+//            Disables the lock-free skip list (ContextSkipList).
+//
+//        #define CTX_SKIPLIST_HEIGHT X
+//            Maximum tower height of skip list nodes, defaults to 16 (good for
+//            around 4^16 keys).
+//
+//        #define CTX_NO_SHARED
+//            Disables the atomically reference counted ContextShared.
+//
+//        #define CTX_NO_EPOCH
+//            Disables epoch based reclamation (ContextEpoch) and snapshot publishing
+//            (ContextSnapshot). Epochs reclaim by allocation epoch, so writers copy
+//            every live node forward rather than retiring individual nodes.
+//
+//        #define CTX_NO_BUDGET
+//            Disables memory budgets (ContextBudget, new_context_budgeted).
+//
+//        #define CTX_NO_REGISTRY
+//            Disables the registry of live contexts (context_register).
+//
+//        #define CTX_ENABLE_STATS
+//            Enables per-context allocation counters, the fragmentation report and the
+//            Prometheus export. Off by default to keep the bump path minimal.
+//
+//        #define CTX_REGISTRY_NAMES X
+//            Maximum number of distinct context names in logs and metrics, defaults
+//            to 64.
+//
+//        #define CTX_ENABLE_PSI
+//            Enables the Linux memory pressure monitor (ContextPressure), reading
+//            /proc/pressure/memory or a cgroup memory.events file. Poll it from the
+//            thread that owns the monitored contexts, not from a separate thread.
+//
+//        #define CTX_ENABLE_HISTOGRAMS
+//            Records log-bucketed latency histograms for the expensive operations
+//            (new_context, context_free, context_clear, decommit, collection and
+//            failed allocations). Uses clock_gettime when POSIX exposes it and C11
+//            timespec_get otherwise.
+//
+//        #define CTX_HISTOGRAM_THREADS X
+//            Per-thread histogram slots, defaults to 16. Further threads share slots.
+//
+//        #define CTX_ENABLE_TRACE
+//            Records allocations, rewinds, clears, frees and failures into a ring
+//            buffer that can be exported as Chrome trace JSON (chrome://tracing,
+//            Perfetto). Uses clock_gettime when POSIX exposes it and C11 timespec_get
+//            otherwise.
+//
+//        #define CTX_TRACE_EVENTS X
+//            Size of the trace ring buffer in events, defaults to 65536.
+//
+//        #define CTX_ENABLE_USDT
+//            Adds SystemTap/USDT probes (provider "ctx") to allocation, rewind,
+//            clear, free and the temp functions. Needs <sys/sdt.h>, probes are a NOP
+//            until a tracer such as bpftrace attaches.
+//
+//        #define CTX_ENABLE_FAULT_STATS
+//            Pre-touches pages as allocations first reach them and counts the page
+//            faults (getrusage) in each context's stats, context_resident reports
+//            resident bytes (mincore). Linux/MacOS only, requires CTX_ENABLE_STATS
+//            and _DEFAULT_SOURCE in strict ISO C builds. Fault counts are per thread
+//            only when _GNU_SOURCE is defined before any include on Linux, otherwise
+//            they are process-wide and include faults from other threads.
+//
+//        #define CTX_ENABLE_PROFILE
+//            Records the peak of every context name and the file and line of every
+//            allocation call, context_profile_fwrite_header then writes a header of
+//            recommended context sizes and CTX_TEMP_SIZE to include in later builds.
+//            Allocations take a global lock, meant for representative profiling runs.
+//            Requires the registry and CTX_ENABLE_STATS.
+//
+//        #define CTX_PROFILE_SITES X
+//            Maximum number of allocation sites the profile tracks, defaults to 1024.
+//
+//        #define CTX_ENABLE_TAGS
+//            Adds context_alloc_tagged and context_talloc_tagged, which count
+//            allocations and bytes per tag in per-thread slots so usage can be
+//            attributed to subsystems. Tags are small integers or names passed to
+//            context_tag, and are exported with the Prometheus metrics.
+//
+//        #define CTX_TAGS X
+//            Number of distinct tags, defaults to 32. Tag 0 collects untagged and
+//            out of range tags.
+//
+//        #define CTX_TAG_THREADS X
+//            Per-thread tag counter slots, defaults to 16. Further threads share slots.
+//
+//        #define CTX_EPOCH_READERS X
+//            Maximum number of registered readers per ContextEpoch, defaults to 64.
+//
 //        #define CTX_TEMP_SIZE X
 //            Defines the size of the built in temporary context, will default to 1MB.
 //
+//        #define CTX_SCRATCH_COUNT X
+//            Number of per-thread scratch contexts handed out by context_get_scratch,
+//            will default to 2. Each is CTX_SCRATCH_SIZE bytes (Defaults to
+//            CTX_TEMP_SIZE).
+//
+//        #define CTX_THREAD_LOCAL
+//            Storage class used for per-thread state if the compiler default does not
+//            suit.
+//
+//        #define CTX_FORGET_DEPTH X
+//            Number of allocations each context remembers for context_forget and
+//            context_forget_n, older boundaries are dropped. Defaults to 1.
+//
 //        #define CTX_LOG(...)
 //            If you do not wish to use printf, you can use this to use a custom logger.
 //
 //    CHANGELOG:
 //        1.0.0 (2025-03-01) - Initial release.
 //        1.1.0 (2025-03-29) - Added forget functions and string helpers with config.
+//        2.0.0 (2026-10-17) - BREAKING: Context.last_location is replaced by the
+//                             CTX_FORGET_DEPTH history and Context gained fields, so
+//                             brace initialisers must become new_context. Added
+//                             typed helpers, cleanups, coroutine frames, transactions,
+//                             scratch contexts, promotion, a copying GC, handles,
+//                             shared contexts, epochs and snapshots, budgets, memory
+//                             pressure and decommit, the registry, opt-in stats,
+//                             histograms, tracing, USDT probes, fault and
+//                             fragmentation reports, site profiling, tags, a B+tree
+//                             and a lock-free skip list.
 //
 //    LICENSE:
 //        Copyright (c) 2025 Alex Macafee
@@ -83,10 +227,10 @@
 #ifndef CTX_H
 #define CTX_H
 
-#define CTX_VERSION_MAJOR 1
-#define CTX_VERSION_MINOR 1
+#define CTX_VERSION_MAJOR 2
+#define CTX_VERSION_MINOR 0
 #define CTX_VERSION_PATCH 0
-#define CTX_VERSION       "1.1.0"
+#define CTX_VERSION       "2.0.0"
 
 #ifdef _WIN32
 #if defined(CTX_BUILD_SHARED)
@@ -118,6 +262,110 @@
 #define CTX_TEMP_SIZE 1 MB
 #endif
 
+#if !defined(CTX_NO_TEMP) && !defined(CTX_SCRATCH_SIZE)
+#define CTX_SCRATCH_SIZE CTX_TEMP_SIZE
+#endif
+
+#ifndef CTX_SCRATCH_COUNT
+#define CTX_SCRATCH_COUNT 2
+#endif
+
+#ifndef CTX_THREAD_LOCAL
+#if defined(__cplusplus)
+#define CTX_THREAD_LOCAL thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define CTX_THREAD_LOCAL _Thread_local
+#elif defined(_MSC_VER)
+#define CTX_THREAD_LOCAL __declspec (thread)
+#else
+#define CTX_THREAD_LOCAL __thread
+#endif
+#endif
+
+// GCC/Clang builtins, MSVC interlocked intrinsics on 64-bit targets. Values are
+// size_t or pointers and every operation is sequentially consistent
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CTX_ATOMIC_LOAD(ptr)                   _InterlockedOr64 ((volatile __int64*)(ptr), 0)
+#define CTX_ATOMIC_STORE(ptr, value)           _InterlockedExchange64 ((volatile __int64*)(ptr), (__int64)(value))
+#define CTX_ATOMIC_FETCH_ADD(ptr, value)       _InterlockedExchangeAdd64 ((volatile __int64*)(ptr), (__int64)(value))
+#define CTX_ATOMIC_CAS(ptr, expected, desired) \
+    (_InterlockedCompareExchange64 ((volatile __int64*)(ptr), (__int64)(desired), (__int64)(expected)) == (__int64)(expected))
+#else
+#define CTX_ATOMIC_LOAD(ptr)                   __atomic_load_n ((ptr), __ATOMIC_SEQ_CST)
+#define CTX_ATOMIC_STORE(ptr, value)           __atomic_store_n ((ptr), (value), __ATOMIC_SEQ_CST)
+#define CTX_ATOMIC_FETCH_ADD(ptr, value)       __atomic_fetch_add ((ptr), (value), __ATOMIC_SEQ_CST)
+#define CTX_ATOMIC_CAS(ptr, expected, desired) __sync_bool_compare_and_swap ((ptr), (expected), (desired))
+#endif
+
+#ifndef CTX_FORGET_DEPTH
+#define CTX_FORGET_DEPTH 1
+#endif
+
+#ifndef CTX_EPOCH_READERS
+#define CTX_EPOCH_READERS 64
+#endif
+
+#ifndef CTX_HANDLE_REWINDS
+#define CTX_HANDLE_REWINDS 4
+#endif
+
+#ifndef CTX_REGISTRY_NAMES
+#define CTX_REGISTRY_NAMES 64
+#endif
+
+#ifndef CTX_HISTOGRAM_THREADS
+#define CTX_HISTOGRAM_THREADS 16
+#endif
+
+// Values below 16ns get exact buckets, then 8 sub-buckets per power of two up to 2^40ns
+#define CTX_HISTOGRAM_SUB_BITS 3
+#define CTX_HISTOGRAM_BUCKETS  (16 + (40 - 4) * (1 << CTX_HISTOGRAM_SUB_BITS))
+
+#ifndef CTX_TRACE_EVENTS
+#define CTX_TRACE_EVENTS 65536
+#endif
+
+#ifndef CTX_CACHE_LINE
+#define CTX_CACHE_LINE 64
+#endif
+
+#ifndef CTX_PROFILE_SITES
+#define CTX_PROFILE_SITES 1024
+#endif
+
+#ifndef CTX_TAGS
+#define CTX_TAGS 32
+#endif
+
+#ifndef CTX_BTREE_NODE_LINES
+#define CTX_BTREE_NODE_LINES 4
+#endif
+
+// Keys and slots fill the node after its count, leaf flag and sibling pointer
+#define CTX_BTREE_KEYS       ((CTX_BTREE_NODE_LINES * CTX_CACHE_LINE - 8 - sizeof (void*)) / (sizeof (uint64_t) + sizeof (void*)))
+#define CTX_BTREE_MAX_HEIGHT 32
+
+#ifndef CTX_SKIPLIST_HEIGHT
+#define CTX_SKIPLIST_HEIGHT 16
+#endif
+
+#ifndef CTX_TAG_THREADS
+#define CTX_TAG_THREADS 16
+#endif
+
+#if defined(CTX_ENABLE_PROFILE) && (defined(CTX_NO_REGISTRY) || !defined(CTX_ENABLE_STATS))
+#error "CTX_ENABLE_PROFILE needs the registry and CTX_ENABLE_STATS"
+#endif
+
+#if CTX_FORGET_DEPTH < 1
+#error "CTX_FORGET_DEPTH must be at least 1"
+#endif
+
+#if CTX_HANDLE_REWINDS < 1
+#error "CTX_HANDLE_REWINDS must be at least 1"
+#endif
+
 #ifndef CTX_API
 #define CTX_API
 #endif
@@ -126,6 +374,36 @@
 #define NULL ((void*)0)
 #endif
 
+#if defined(__cplusplus)
+#define CTX_ALIGNOF(type) alignof (type)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define CTX_ALIGNOF(type) _Alignof (type)
+#else
+#define CTX_ALIGNOF(type) offsetof (struct { char c; type t; }, t)
+#endif
+
+#if defined(_MSC_VER) && !defined(__cplusplus)
+#define CTX_INLINE static __inline
+#else
+#define CTX_INLINE static inline
+#endif
+
+#if defined(__GNUC__)
+#define CTX_FORCE_INLINE __attribute__ ((always_inline)) inline
+#elif defined(_MSC_VER)
+#define CTX_FORCE_INLINE __forceinline
+#else
+#define CTX_FORCE_INLINE inline
+#endif
+
+#ifndef CTX_MAX_ALIGNMENT
+#if defined(__cplusplus) || (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L)
+#define CTX_MAX_ALIGNMENT CTX_ALIGNOF (max_align_t)
+#else
+#define CTX_MAX_ALIGNMENT CTX_ALIGNOF (long double)
+#endif
+#endif
+
 #ifndef CTX_NO_SIZE_HELPERS
 #define KB *1024
 #define MB *(1024 * 1024)
@@ -136,26 +414,384 @@
 // TYPES DEFINITION
 // -----------------------------------------------------------------------------
 #include <stddef.h>
-
-#ifndef CTX_NO_STR
+#include <stdint.h>
+#include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+
+#ifndef CTX_NO_CLEANUP
+typedef void (*ContextCleanupFn) (void* data);
+
+// Stored inside the context it belongs to, newest first
+typedef struct ContextCleanup {
+    ContextCleanupFn callback;
+    void* data;
+    struct ContextCleanup* next;
+} ContextCleanup;
+#endif
+
+#ifndef CTX_NO_BUDGET
+typedef struct ContextBudget ContextBudget;
+
+// Called when a charge crosses the soft limit, and before a hard limit rejection is retried
+typedef void (*ContextBudgetFn) (ContextBudget* budget, size_t requested, int rejected, void* user);
+
+// Charges propagate to every parent, a limit of 0 means unlimited
+struct ContextBudget {
+    const char* name;
+    ContextBudget* parent;
+    size_t used;
+    size_t peak;
+    size_t soft_limit;
+    size_t hard_limit;
+    size_t rejections;
+    ContextBudgetFn callback;
+    void* user;
+};
+#endif
+
+#ifdef CTX_ENABLE_STATS
+// Allocated counts every byte ever handed out, peak is the highest location reached
+typedef struct ContextStats {
+    size_t allocations;
+    size_t allocated;
+    size_t failures;
+    size_t peak;
+#ifdef CTX_ENABLE_FAULT_STATS
+    size_t minor_faults;
+    size_t major_faults;
+#endif
+} ContextStats;
+#endif
+
+#if defined(CTX_ENABLE_FAULT_STATS) && !defined(CTX_ENABLE_STATS)
+#error "CTX_ENABLE_FAULT_STATS needs CTX_ENABLE_STATS"
 #endif
 
 typedef struct Context {
     void* buffer;
     size_t location;
-    size_t last_location;
+    size_t committed;
+    size_t history[CTX_FORGET_DEPTH];
+    size_t history_head;
+    size_t history_count;
     size_t size;
+    size_t floor;
+    size_t depth;
+    uint32_t generation;
+#ifndef CTX_NO_HANDLES
+    // Lowest location each generation rewound to, increasing, older entries are lost
+    size_t rewinds[CTX_HANDLE_REWINDS];
+    uint32_t rewind_generations[CTX_HANDLE_REWINDS];
+    uint32_t rewind_count;
+    uint32_t rewind_lost;
+#endif
+#ifdef CTX_ENABLE_STATS
+    size_t padding;
+    size_t history_padding[CTX_FORGET_DEPTH];
+#endif
+#ifndef CTX_NO_CLEANUP
+    ContextCleanup* cleanups;
+#endif
+#ifndef CTX_NO_BUDGET
+    ContextBudget* budget;
+#endif
+#ifndef CTX_NO_REGISTRY
+    const char* name;
+    struct Context* registry_next;
+    int registered;
+#endif
+#ifdef CTX_ENABLE_STATS
+    ContextStats stats;
+#endif
 } Context;
 
+#ifndef CTX_NO_REGISTRY
+// Committed is the high water mark of used bytes since the last decommit
+typedef struct ContextUsage {
+    const char* name;
+    size_t contexts;
+    size_t reserved;
+    size_t committed;
+    size_t used;
+#ifdef CTX_ENABLE_STATS
+    size_t padding;
+    ContextStats stats;
+#endif
+#ifdef CTX_ENABLE_FAULT_STATS
+    size_t resident;
+#endif
+} ContextUsage;
+#endif
+
+#ifdef CTX_ENABLE_STATS
+// Where the bytes of a context went, from its start to the end of its buffer
+typedef struct ContextFragmentation {
+    size_t reserved;    // Size of the buffer
+    size_t used;        // Bytes below the current location
+    size_t requested;   // Bytes asked for by the live allocations
+    size_t padding;     // Alignment padding between the live allocations
+    size_t slack;       // Touched by earlier allocations but rewound since
+    size_t tail;        // Never touched
+    double utilization; // Requested over used bytes
+} ContextFragmentation;
+#endif
+
+#ifndef CTX_NO_TEMP
+// Marks the point a scratch context is rewound to on release
+typedef struct ContextScratch {
+    Context* context;
+    size_t location;
+} ContextScratch;
+#endif
+
+// Deep copies data into context, returning NULL on failure
+typedef void* (*ContextPromoteFn) (Context* context, const void* data, void* user);
+
+// Returned by context_begin, must be committed or rolled back innermost first
+typedef struct ContextTransaction {
+    size_t location;
+    size_t floor;
+    size_t depth;
+#ifdef CTX_ENABLE_STATS
+    size_t padding;
+#endif
+} ContextTransaction;
+
+#ifndef CTX_NO_GC
+typedef struct ContextGC ContextGC;
+
+// Trace must call context_gc_visit on every pointer field of the object
+typedef struct ContextGCType {
+    const char* name;
+    void (*trace) (ContextGC* gc, void* object);
+} ContextGCType;
+
+// Precedes every collectable object, padded to CTX_MAX_ALIGNMENT
+typedef struct ContextGCHeader {
+    const ContextGCType* type;
+    size_t size;
+    void* forward;
+} ContextGCHeader;
+
+struct ContextGC {
+    Context* from;
+    Context* to;
+    size_t copied;
+};
+#endif
+
+#ifndef CTX_NO_SHARED
+// Receives the context of the last reference, NULL means context_free. The pointer dies
+// when the callback returns, so a callback that keeps the context must copy the Context
+typedef void (*ContextReleaseFn) (Context* context, void* user);
+
+typedef struct ContextShared {
+    Context context;
+    size_t references;
+    ContextReleaseFn release;
+    void* user;
+} ContextShared;
+#endif
+
+#ifndef CTX_NO_EPOCH
+// State is 0 while outside a read section, otherwise (epoch << 1) | 1
+typedef struct ContextEpochReader {
+    size_t claimed;
+    size_t state;
+    char padding[CTX_CACHE_LINE - 2 * sizeof (size_t)];
+} ContextEpochReader;
+
+// Allocations made in epoch E are reclaimed in bulk once the epoch reaches E + 2, whether or
+// not they are still reachable. Reclamation follows the allocation epoch, there is no retire
+// step: writers must republish (copy into a fresh epoch_alloc) everything still live before
+// advancing twice, EG. rebuilding a whole version each epoch as ContextSnapshot does
+typedef struct ContextEpoch {
+    size_t epoch;
+    Context contexts[3];
+    ContextEpochReader readers[CTX_EPOCH_READERS];
+} ContextEpoch;
+
+// Double buffered: at most one retired context waits for its grace period
+typedef struct ContextSnapshot {
+    ContextEpoch* epoch;
+    void* root;
+    Context current;
+    Context retired;
+    Context spare;
+    size_t retired_epoch;
+} ContextSnapshot;
+#endif
+
+#ifdef CTX_ENABLE_PSI
+// Called under pressure after the registered contexts are decommitted, EG. to trim pools
+typedef void (*ContextPressureFn) (void* user);
+
+typedef struct ContextPressure {
+    const char* path;
+    double threshold;
+    size_t events;
+    Context** contexts;
+    size_t count;
+    ContextPressureFn callback;
+    void* user;
+} ContextPressure;
+#endif
+
+#ifdef CTX_ENABLE_HISTOGRAMS
+typedef enum ContextOperation {
+    CTX_OP_NEW,
+    CTX_OP_FREE,
+    CTX_OP_CLEAR,
+    CTX_OP_DECOMMIT,
+    CTX_OP_COLLECT,
+    CTX_OP_FAILURE,
+    CTX_OP_COUNT
+} ContextOperation;
+
+typedef struct ContextHistogram {
+    size_t count;
+    uint64_t total;
+    size_t buckets[CTX_HISTOGRAM_BUCKETS];
+} ContextHistogram;
+#endif
+
+#ifdef CTX_ENABLE_TRACE
+typedef enum ContextTraceType {
+    CTX_TRACE_ALLOC,
+    CTX_TRACE_REWIND,
+    CTX_TRACE_CLEAR,
+    CTX_TRACE_FREE,
+    CTX_TRACE_FAILURE,
+    CTX_TRACE_MARK,
+    CTX_TRACE_BEGIN,
+    CTX_TRACE_END
+} ContextTraceType;
+
+// Sequence is written last, a mismatch means the slot is being overwritten
+typedef struct ContextTraceEvent {
+    size_t sequence;
+    uint64_t timestamp;
+    const void* context;
+    const char* name;
+    size_t value;
+    size_t thread;
+    ContextTraceType type;
+} ContextTraceEvent;
+#endif
+
+#ifdef CTX_ENABLE_TAGS
+// Totals for one tag across all threads, name is NULL for tags never passed to context_tag
+typedef struct ContextTagUsage {
+    const char* name;
+    size_t allocations;
+    size_t bytes;
+} ContextTagUsage;
+#endif
+
+#ifndef CTX_NO_HANDLES
+// A generation of 0 is never valid and marks a failed create
+typedef struct ContextHandle {
+    uint32_t index;
+    uint32_t generation;
+} ContextHandle;
+
+// Free slots have a NULL object and chain through context_generation
+typedef struct ContextHandleSlot {
+    void* object;
+    uint32_t generation;
+    uint32_t context_generation;
+} ContextHandleSlot;
+
+typedef struct ContextHandleTable {
+    Context* context;
+    ContextHandleSlot* slots;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t free_list;
+} ContextHandleTable;
+#endif
+
+#ifndef CTX_NO_BTREE
+// Inner nodes keep the smallest key under each child, lookups never read the first one as
+// smaller keys always descend left. Next links nodes on the same level
+typedef struct ContextBTreeNode {
+    uint32_t count;
+    uint32_t leaf;
+    struct ContextBTreeNode* next;
+    uint64_t keys[CTX_BTREE_KEYS];
+    void* slots[CTX_BTREE_KEYS];
+} ContextBTreeNode;
+
+// Nodes are never freed on their own, the whole tree goes with its context
+typedef struct ContextBTree {
+    Context* context;
+    ContextBTreeNode* root;
+    size_t count;
+    size_t height;
+} ContextBTree;
+
+typedef struct ContextBTreeCursor {
+    const ContextBTreeNode* leaf;
+    uint32_t index;
+} ContextBTreeCursor;
+#endif
+
+#ifndef CTX_NO_SKIPLIST
+// Nodes are allocated with only as many next pointers as their height
+typedef struct ContextSkipNode {
+    uint64_t key;
+    void* value;
+    size_t height;
+    struct ContextSkipNode* next[1];
+} ContextSkipNode;
+
+// Insert-only, nodes live until the context is cleared, then the list is built again
+typedef struct ContextSkipList {
+    Context* context;
+    ContextSkipNode* head;
+    size_t count;
+} ContextSkipList;
+
+typedef struct ContextSkipCursor {
+    const ContextSkipNode* node;
+} ContextSkipCursor;
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 CTX_API Context new_context (size_t size);
+
+#ifndef CTX_NO_BUDGET
+CTX_API ContextBudget new_context_budget (const char* name, ContextBudget* parent, size_t soft_limit, size_t hard_limit);
+CTX_API Context new_context_budgeted (size_t size, ContextBudget* budget);
+CTX_API size_t context_budget_used (const ContextBudget* budget);
+#endif
 CTX_API void* context_alloc (Context* context, size_t size);
+CTX_API void* context_alloc_aligned (Context* context, size_t size, size_t alignment);
+CTX_API void* context_alloc_array (Context* context, size_t size, size_t count, size_t alignment);
+CTX_API void* context_alloc_zeroed (Context* context, size_t size, size_t count, size_t alignment);
+CTX_API void* context_alloc_atomic (Context* context, size_t size, size_t alignment);
 CTX_API size_t context_forget (Context* context);
+CTX_API size_t context_forget_n (Context* context, size_t count);
+CTX_API size_t context_rewind (Context* context, size_t location);
+
+#ifndef CTX_NO_CLEANUP
+CTX_API int context_defer (Context* context, ContextCleanupFn callback, void* data);
+CTX_API void* context_alloc_with_cleanup (Context* context, size_t size, size_t alignment, ContextCleanup** cleanup);
+#endif
+
+CTX_API void* context_promote (Context* context, const void* data, size_t size, size_t alignment);
+CTX_API void* context_promote_array (Context* context, const void* data, size_t size, size_t count, size_t alignment);
+CTX_API int context_promote_many (Context* context, void** items, const size_t* sizes, size_t count, size_t alignment);
+CTX_API void* context_promote_range (Context* context, const Context* source, size_t from, size_t to);
+CTX_API void* context_promote_deep (Context* context, const void* data, ContextPromoteFn callback, void* user);
+
+CTX_API ContextTransaction context_begin (Context* context);
+CTX_API int context_commit (Context* context, ContextTransaction* transaction);
+CTX_API size_t context_rollback (Context* context, ContextTransaction* transaction);
 
 #ifndef CTX_NO_STR
 CTX_API char* context_alloc_cstring (Context* context, const char* str);
@@ -164,6 +800,28 @@ CTX_API char* context_alloc_cstringf (Context* context, const char* fmt, ...);
 
 CTX_API void context_clear (Context* context);
 CTX_API void context_free (Context* context);
+CTX_API size_t context_decommit (Context* context);
+
+#ifdef CTX_ENABLE_STATS
+CTX_API ContextFragmentation context_fragmentation (const Context* context);
+CTX_API void context_fragmentation_log (const Context* context);
+#endif
+
+#ifdef CTX_ENABLE_FAULT_STATS
+CTX_API size_t context_resident (const Context* context);
+#endif
+
+#ifndef CTX_NO_REGISTRY
+CTX_API void context_register (Context* context, const char* name);
+CTX_API void context_unregister (Context* context);
+CTX_API size_t context_registry_report (ContextUsage* usage, size_t capacity);
+CTX_API void context_registry_log (void);
+
+#ifdef CTX_ENABLE_STATS
+CTX_API size_t context_metrics_write (char* buffer, size_t capacity);
+CTX_API size_t context_metrics_fwrite (FILE* file);
+#endif
+#endif
 
 #ifndef CTX_NO_TEMP
 CTX_API void* context_talloc (size_t size);
@@ -176,169 +834,3271 @@ CTX_API char* context_talloc_cstringf (const char* fmt, ...);
 
 CTX_API void context_tclear (void);
 CTX_API void context_tfree (void);
+CTX_API size_t context_tdecommit (void);
+
+CTX_API ContextScratch context_get_scratch (Context** conflicts, size_t count);
+CTX_API void context_release_scratch (ContextScratch* scratch);
+CTX_API void context_free_scratch (void);
 #endif // CTX_NO_TEMP
 
-#ifdef __cplusplus
-}
+#ifndef CTX_NO_GC
+CTX_API void* context_gc_alloc (Context* context, const ContextGCType* type, size_t size);
+CTX_API void context_gc_visit (ContextGC* gc, void** slot);
+CTX_API size_t context_gc_collect (Context* from, Context* to, void** roots[], size_t count);
 #endif
 
-// -----------------------------------------------------------------------------
-// function IMPLEMENTATION
-// -----------------------------------------------------------------------------
-#define CTX_IMPL
-#if defined(CTX_IMPL) || defined(CTX_IMPLEMENTATION)
+#ifndef CTX_NO_SHARED
+CTX_API ContextShared* context_share (Context* context, ContextReleaseFn release, void* user);
+CTX_API ContextShared* context_retain (ContextShared* shared);
+CTX_API void context_release (ContextShared* shared);
+#endif
+
+#ifndef CTX_NO_EPOCH
+CTX_API int context_epoch_init (ContextEpoch* manager, size_t size);
+CTX_API void context_epoch_free (ContextEpoch* manager);
+CTX_API ContextEpochReader* context_epoch_register (ContextEpoch* manager);
+CTX_API void context_epoch_unregister (ContextEpochReader* reader);
+CTX_API void context_epoch_enter (ContextEpoch* manager, ContextEpochReader* reader);
+CTX_API void context_epoch_exit (ContextEpochReader* reader);
+CTX_API void* context_epoch_alloc (ContextEpoch* manager, size_t size, size_t alignment);
+CTX_API int context_epoch_advance (ContextEpoch* manager);
+
+CTX_API void context_snapshot_init (ContextSnapshot* snapshot, ContextEpoch* epoch);
+CTX_API void context_snapshot_free (ContextSnapshot* snapshot);
+CTX_API Context context_snapshot_build (ContextSnapshot* snapshot, size_t size);
+CTX_API int context_snapshot_publish (ContextSnapshot* snapshot, Context* next, void* root);
+CTX_API int context_snapshot_reclaim (ContextSnapshot* snapshot);
+CTX_API void* context_snapshot_acquire (ContextSnapshot* snapshot, ContextEpochReader* reader);
+CTX_API void context_snapshot_release (ContextEpochReader* reader);
+#endif
+
+#ifdef CTX_ENABLE_PSI
+CTX_API ContextPressure new_context_pressure (const char* path, double threshold, Context** contexts, size_t count);
+CTX_API int context_pressure_poll (ContextPressure* monitor);
+#endif
+
+#ifdef CTX_ENABLE_HISTOGRAMS
+CTX_API const char* context_operation_name (ContextOperation operation);
+CTX_API void context_histogram_read (ContextOperation operation, ContextHistogram* histogram);
+CTX_API uint64_t context_histogram_percentile (const ContextHistogram* histogram, double percentile);
+CTX_API void context_histogram_log (void);
+#endif
+
+#ifdef CTX_ENABLE_TRACE
+CTX_API void context_trace_mark (const char* name);
+CTX_API void context_trace_begin (const char* name);
+CTX_API void context_trace_end (const char* name);
+CTX_API void context_trace_reset (void);
+CTX_API size_t context_trace_fwrite_chrome (FILE* file);
+#endif
+
+#ifdef CTX_ENABLE_TAGS
+CTX_API uint32_t context_tag (const char* name);
+CTX_API void* context_alloc_tagged (Context* context, size_t size, size_t alignment, uint32_t tag);
+CTX_API size_t context_tag_report (ContextTagUsage* usage, size_t capacity);
 
 #ifndef CTX_NO_TEMP
-static Context global_temp_context = {NULL, 0, 0, 0};
+CTX_API void* context_talloc_tagged (size_t size, uint32_t tag);
+#endif
 #endif
 
-#ifdef __cplusplus
-extern "C" {
+#ifdef CTX_ENABLE_PROFILE
+CTX_API void context_profile_site (const char* file, int line);
+CTX_API void context_profile_reset (void);
+CTX_API size_t context_profile_fwrite_header (FILE* file, double headroom);
 #endif
 
-Context new_context (size_t size) {
-    Context ctx = {
-        .buffer        = CTX_MALLOC (size),
-        .location      = 0,
-        .last_location = 0,
-        .size          = size,
-    };
+#ifndef CTX_NO_HANDLES
+CTX_API ContextHandleTable context_handle_table (Context* storage, Context* context, uint32_t capacity);
+CTX_API ContextHandle context_handle_create (ContextHandleTable* table, void* object);
+CTX_API void* context_handle_get (const ContextHandleTable* table, ContextHandle handle);
+CTX_API int context_handle_relocate (ContextHandleTable* table, ContextHandle handle, void* object);
+CTX_API void context_handle_retarget (ContextHandleTable* table, Context* context);
+CTX_API void context_handle_release (ContextHandleTable* table, ContextHandle handle);
+#endif
 
-    return ctx;
+#ifndef CTX_NO_BTREE
+CTX_API ContextBTree context_btree (Context* context);
+CTX_API int context_btree_insert (ContextBTree* tree, uint64_t key, void* value);
+CTX_API int context_btree_bulk_load (ContextBTree* tree, const uint64_t* keys, void* const* values, size_t count);
+CTX_API void** context_btree_find (const ContextBTree* tree, uint64_t key);
+CTX_API ContextBTreeCursor context_btree_seek (const ContextBTree* tree, uint64_t key);
+CTX_API int context_btree_next (ContextBTreeCursor* cursor, uint64_t* key, void** value);
+#endif
+
+#ifndef CTX_NO_SKIPLIST
+CTX_API ContextSkipList context_skiplist (Context* context);
+CTX_API int context_skiplist_insert (ContextSkipList* list, uint64_t key, void* value);
+CTX_API int context_skiplist_find (const ContextSkipList* list, uint64_t key, void** value);
+CTX_API ContextSkipCursor context_skiplist_seek (const ContextSkipList* list, uint64_t key);
+CTX_API int context_skiplist_next (ContextSkipCursor* cursor, uint64_t* key, void** value);
+#endif
+
+// Inlined bump behind the allocation functions, alignment must already be a power of two
+CTX_INLINE void* ctx__alloc (Context* context, size_t size, size_t alignment);
+CTX_INLINE void* ctx__alloc_array (Context* context, size_t size, size_t count, size_t alignment);
+
+#ifdef __cplusplus
 }
+#endif
 
-void* context_alloc (Context* context, size_t size) {
-    if (context->location + size > context->size) {
-        CTX_LOG ("[ERROR]: Static context unable to allocate %zu bytes!\n", size);
-        return NULL;
-    }
+#ifndef CTX_NO_TYPED_HELPERS
+// Size and alignment are resolved at compile time, array counts are overflow checked. An
+// alignof is always a power of two, so these go straight to the inlined bump
+#define ctx_new(context, type) \
+    ((type*)ctx__alloc ((context), sizeof (type), CTX_ALIGNOF (type)))
+#define ctx_new_array(context, type, count) \
+    ((type*)ctx__alloc_array ((context), sizeof (type), (count), CTX_ALIGNOF (type)))
+#define ctx_new_zeroed(context, type) \
+    ((type*)context_alloc_zeroed ((context), sizeof (type), 1, CTX_ALIGNOF (type)))
+#define ctx_new_array_zeroed(context, type, count) \
+    ((type*)context_alloc_zeroed ((context), sizeof (type), (count), CTX_ALIGNOF (type)))
+#define ctx_promote(context, data, type, count) \
+    ((type*)context_promote_array ((context), (data), sizeof (type), (count), CTX_ALIGNOF (type)))
+
+// Translates a pointer inside a range copied by context_promote_range
+#define ctx_relocate(pointer, source_base, target_base) \
+    ((void*)((char*)(target_base) + ((const char*)(pointer) - (const char*)(source_base))))
 
-    context->last_location = context->location;
+#ifdef __cplusplus
+#include <new>
+#include <type_traits>
+#include <utility>
 
-    char* buffer_start = (void*)context->buffer;
-    void* chunk        = &buffer_start[context->location];
+#ifndef CTX_NO_CLEANUP
+template <typename T>
+struct ContextArrayRecord {
+    T* items;
+    size_t count;
+};
 
-    context->location += size;
-    return chunk;
+template <typename T>
+size_t context_array_offset () {
+    return (sizeof (ContextArrayRecord<T>) + alignof (T) - 1) & ~(alignof (T) - 1);
 }
 
-size_t context_forget (Context* context) {
-    if (context->last_location > context->location) {
-        CTX_LOG ("[ERROR]: Cannot forget last allocation!\n");
-        return 0;
-    }
+template <typename T>
+void context_destroy_object (void* data) {
+    ((T*)data)->~T ();
+}
 
-    size_t reverted   = context->location - context->last_location;
-    context->location = context->last_location;
+template <typename T>
+void context_destroy_array (void* data) {
+    ContextArrayRecord<T>* record = (ContextArrayRecord<T>*)data;
 
-    return reverted;
+    for (size_t i = record->count; i > 0; i--) {
+        record->items[i - 1].~T ();
+    }
 }
+#endif // CTX_NO_CLEANUP
 
-#ifndef CTX_NO_STR
-char* context_alloc_cstring (Context* context, const char* str) {
-    size_t string_length = strlen (str);
+// Constructs a T in place, non-trivial destructors run on clear/rewind/free
+template <typename T, typename... Args>
+T* context_new (Context* context, Args&&... args) {
+#ifndef CTX_NO_CLEANUP
+    // The cleanup record shares the object's allocation, so a forget reverts both
+    if (!std::is_trivially_destructible<T>::value) {
+        ContextCleanup* cleanup;
+
+        void* chunk = context_alloc_with_cleanup (context, sizeof (T), alignof (T), &cleanup);
+        if (chunk == NULL) {
+            return NULL;
+        }
+
+        T* object         = ::new (chunk) T (std::forward<Args> (args)...);
+        cleanup->data     = object;
+        cleanup->callback = &context_destroy_object<T>;
 
-    char* chunk = context_alloc (context, string_length + 1);
+        return object;
+    }
+#endif
+
+    void* chunk = ctx__alloc (context, sizeof (T), alignof (T));
     if (chunk == NULL) {
         return NULL;
     }
 
-    strcpy (chunk, str);
-
-    return chunk;
+    return ::new (chunk) T (std::forward<Args> (args)...);
 }
 
-char* context_alloc_cstringf (Context* context, const char* fmt, ...) {
-    va_list args;
-    va_start (args, fmt);
+// Default initialises every element, trivial types are left untouched like a raw bump
+template <typename T>
+T* context_new_array (Context* context, size_t count) {
+#ifndef CTX_NO_CLEANUP
+    // Cleanup record, element count and elements are one allocation, so a forget reverts all
+    if (!std::is_trivially_destructible<T>::value) {
+        size_t offset = context_array_offset<T> ();
 
-    va_list args_copy;
-    va_copy (args_copy, args);
-    size_t string_length = vsnprintf (NULL, 0, fmt, args_copy) + 1;
-    va_end (args_copy);
+        if (count > (SIZE_MAX - offset) / sizeof (T)) {
+            CTX_LOG ("[ERROR]: Allocation of %zu x %zu bytes overflows!\n", count, sizeof (T));
+            return NULL;
+        }
 
-    char* buffer = context_alloc (context, string_length);
-    if (buffer == NULL) {
-        va_end (args);
+        ContextCleanup* cleanup;
+        size_t alignment = alignof (T) > alignof (ContextArrayRecord<T>) ? alignof (T) : alignof (ContextArrayRecord<T>);
+
+        char* chunk = (char*)context_alloc_with_cleanup (context, offset + sizeof (T) * count, alignment, &cleanup);
+        if (chunk == NULL) {
+            return NULL;
+        }
+
+        ContextArrayRecord<T>* record = (ContextArrayRecord<T>*)chunk;
+        record->items                 = (T*)(chunk + offset);
+        record->count                 = 0;
+
+        // Counting as elements are built keeps a throwing constructor from destroying the rest
+        cleanup->data     = record;
+        cleanup->callback = &context_destroy_array<T>;
+
+        for (; record->count < count; record->count++) {
+            ::new ((void*)&record->items[record->count]) T;
+        }
+
+        return record->items;
+    }
+#endif
+
+    T* items = (T*)ctx__alloc_array (context, sizeof (T), count, alignof (T));
+    if (items == NULL) {
         return NULL;
     }
 
-    vsnprintf (buffer, string_length, fmt, args);
-    va_end (args);
+    for (size_t i = 0; i < count; i++) {
+        ::new ((void*)&items[i]) T;
+    }
 
-    return NULL;
+    return items;
 }
-#endif
+#endif // __cplusplus
+#endif // CTX_NO_TYPED_HELPERS
 
-void context_clear (Context* context) {
-    context->location      = 0;
-    context->last_location = 0;
-}
+#if defined(__cplusplus) && __cplusplus >= 202002L && !defined(CTX_NO_COROUTINES)
+// Context used for frames of coroutines that do not take a Context parameter
+inline thread_local Context* context_frame_current = NULL;
 
-void context_free (Context* context) {
-    context->last_location = 0;
-    context->location      = 0;
-    context->size          = 0;
+// Sets the calling thread's frame context for the lifetime of the scope
+struct ContextFrameScope {
+    Context* previous;
 
-    CTX_FREE (context->buffer);
-}
+    explicit ContextFrameScope (Context* context) : previous (context_frame_current) {
+        context_frame_current = context;
+    }
 
-#ifndef CTX_NO_TEMP
-void* context_talloc (size_t size) {
-    if (global_temp_context.size == 0) {
-        global_temp_context = new_context (CTX_TEMP_SIZE);
+    ~ContextFrameScope () {
+        context_frame_current = previous;
     }
 
-    return context_alloc (&global_temp_context, size);
-}
+    ContextFrameScope (const ContextFrameScope&)            = delete;
+    ContextFrameScope& operator= (const ContextFrameScope&) = delete;
+};
 
-size_t context_tforget (void) {
-    return context_forget (&global_temp_context);
+struct alignas (__STDCPP_DEFAULT_NEW_ALIGNMENT__) ContextFrameHeader {
+    Context* context;
+    size_t location;
+};
+
+// Falls back to global new when there is no context or it is full
+inline void* context_frame_alloc (Context* context, size_t size) {
+    ContextFrameHeader* header = NULL;
+    size_t location            = 0;
+
+    if (context != NULL && context->buffer != NULL) {
+        location = context->location;
+        header   = (ContextFrameHeader*)context_alloc_aligned (
+            context, sizeof (ContextFrameHeader) + size, alignof (ContextFrameHeader));
+    }
+
+    if (header == NULL) {
+        context = NULL;
+        header  = (ContextFrameHeader*)::operator new (sizeof (ContextFrameHeader) + size);
+    }
+
+    header->context  = context;
+    header->location = location;
+
+    return header + 1;
+}
+
+// Frames released in LIFO order are rewound, anything else waits for clear/free
+inline void context_frame_release (void* frame, size_t size) {
+    ContextFrameHeader* header = (ContextFrameHeader*)frame - 1;
+    Context* context           = header->context;
+
+    if (context == NULL) {
+        ::operator delete (header);
+        return;
+    }
+
+    char* frame_end = (char*)frame + size;
+    if (frame_end == (char*)context->buffer + context->location) {
+        context_rewind (context, header->location);
+    }
+}
+
+// Inherit from this in a promise_type, frames come from the first Context
+// argument of the coroutine, otherwise from context_frame_current
+struct ContextPromise {
+    static void* operator new (size_t size) {
+        return context_frame_alloc (context_frame_current, size);
+    }
+
+    // GCC pairs these templates with the sized delete and warns (-Wmismatched-new-delete) in every
+    // coroutine taking a Context. Forced inlining leaves only context_frame_alloc to match
+    template <typename... Args>
+    CTX_FORCE_INLINE static void* operator new (size_t size, Context& context, Args&...) {
+        return context_frame_alloc (&context, size);
+    }
+
+    template <typename... Args>
+    CTX_FORCE_INLINE static void* operator new (size_t size, Context* context, Args&...) {
+        return context_frame_alloc (context, size);
+    }
+
+    static void operator delete (void* frame, size_t size) {
+        context_frame_release (frame, size);
+    }
+};
+#endif // CTX_NO_COROUTINES
+
+// -----------------------------------------------------------------------------
+// function IMPLEMENTATION
+// -----------------------------------------------------------------------------
+#define CTX_IMPL
+#if defined(CTX_IMPL) || defined(CTX_IMPLEMENTATION)
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef CTX_ENABLE_FAULT_STATS
+#include <sys/resource.h>
+
+// mincore sits next to madvise, both are hidden by strict ISO modes
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(MADV_DONTNEED)
+#error "CTX_ENABLE_FAULT_STATS needs mincore, define _DEFAULT_SOURCE in strict ISO C builds"
+#endif
+#endif
+
+#ifdef CTX_ENABLE_USDT
+#include <sys/sdt.h>
+#define CTX_PROBE1(name, a)          DTRACE_PROBE1 (ctx, name, a)
+#define CTX_PROBE2(name, a, b)       DTRACE_PROBE2 (ctx, name, a, b)
+#define CTX_PROBE3(name, a, b, c)    DTRACE_PROBE3 (ctx, name, a, b, c)
+#else
+#define CTX_PROBE1(name, a)
+#define CTX_PROBE2(name, a, b)
+#define CTX_PROBE3(name, a, b, c)
+#endif
+
+#if defined(CTX_ENABLE_HISTOGRAMS) || defined(CTX_ENABLE_TRACE)
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+
+#if !defined(CLOCK_MONOTONIC) && !defined(TIME_UTC)
+#error "CTX_ENABLE_HISTOGRAMS and CTX_ENABLE_TRACE need C11 or _POSIX_C_SOURCE >= 199309L"
+#endif
+#endif
+#endif
+
+#ifndef CTX_NO_TEMP
+static Context global_temp_context;
+static CTX_THREAD_LOCAL Context global_scratch_contexts[CTX_SCRATCH_COUNT];
+#endif
+
+#ifndef CTX_NO_REGISTRY
+static Context* global_registry_head;
+static size_t global_registry_lock;
+#endif
+
+#ifdef CTX_ENABLE_HISTOGRAMS
+static size_t global_histograms[CTX_HISTOGRAM_THREADS][CTX_OP_COUNT][CTX_HISTOGRAM_BUCKETS + 2];
+static size_t global_histogram_threads;
+static CTX_THREAD_LOCAL size_t global_histogram_slot;
+#endif
+
+#ifdef CTX_ENABLE_TRACE
+static ContextTraceEvent global_trace_events[CTX_TRACE_EVENTS];
+static size_t global_trace_head;
+static size_t global_trace_threads;
+static CTX_THREAD_LOCAL size_t global_trace_thread;
+#endif
+
+#ifdef CTX_ENABLE_TAGS
+static size_t global_tag_counters[CTX_TAG_THREADS][CTX_TAGS][2];
+static const char* global_tag_names[CTX_TAGS];
+static size_t global_tag_count = 1;
+static size_t global_tag_lock;
+static size_t global_tag_threads;
+static CTX_THREAD_LOCAL size_t global_tag_slot;
+#endif
+
+#ifndef CTX_NO_SKIPLIST
+static CTX_THREAD_LOCAL uint64_t global_skiplist_seed;
+#endif
+
+#ifdef CTX_ENABLE_PROFILE
+typedef struct ContextProfileSite {
+    const char* file;
+    int line;
+    const char* name;
+    size_t allocations;
+    size_t bytes;
+    size_t largest;
+    size_t peak;
+} ContextProfileSite;
+
+typedef struct ContextProfileName {
+    const char* name;
+    size_t peak;
+} ContextProfileName;
+
+static ContextProfileSite global_profile_sites[CTX_PROFILE_SITES];
+static ContextProfileName global_profile_names[CTX_REGISTRY_NAMES];
+static size_t global_profile_dropped;
+static CTX_THREAD_LOCAL const char* global_profile_file;
+static CTX_THREAD_LOCAL int global_profile_line;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(CTX_ENABLE_HISTOGRAMS) || defined(CTX_ENABLE_TRACE)
+static uint64_t ctx__now (void) {
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter (&counter);
+    QueryPerformanceFrequency (&frequency);
+
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#else
+    // Strict ISO C hides clock_gettime, the wall clock can step but still times operations
+    struct timespec now;
+    timespec_get (&now, TIME_UTC);
+
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+#endif
+
+#ifdef CTX_ENABLE_HISTOGRAMS
+static size_t ctx__histogram_bucket (uint64_t nanoseconds) {
+    if (nanoseconds < 16) {
+        return (size_t)nanoseconds;
+    }
+
+    size_t exponent = 0;
+    while ((nanoseconds >> exponent) > 1) {
+        exponent++;
+    }
+
+    if (exponent >= 40) {
+        return CTX_HISTOGRAM_BUCKETS - 1;
+    }
+
+    size_t sub = (size_t)(nanoseconds >> (exponent - CTX_HISTOGRAM_SUB_BITS)) & ((1 << CTX_HISTOGRAM_SUB_BITS) - 1);
+
+    return 16 + (exponent - 4) * (1 << CTX_HISTOGRAM_SUB_BITS) + sub;
+}
+
+// Each thread claims its own slot, the counters are only shared once slots run out
+static void ctx__histogram_record (ContextOperation operation, uint64_t nanoseconds) {
+    if (global_histogram_slot == 0) {
+        global_histogram_slot = CTX_ATOMIC_FETCH_ADD (&global_histogram_threads, (size_t)1) % CTX_HISTOGRAM_THREADS + 1;
+    }
+
+    size_t* counters = global_histograms[global_histogram_slot - 1][operation];
+
+    CTX_ATOMIC_FETCH_ADD (&counters[ctx__histogram_bucket (nanoseconds)], (size_t)1);
+    CTX_ATOMIC_FETCH_ADD (&counters[CTX_HISTOGRAM_BUCKETS], (size_t)1);
+    CTX_ATOMIC_FETCH_ADD (&counters[CTX_HISTOGRAM_BUCKETS + 1], (size_t)nanoseconds);
+}
+
+#define CTX_TIME_BEGIN()        uint64_t ctx__started = ctx__now ()
+#define CTX_TIME_END(operation) ctx__histogram_record ((operation), ctx__now () - ctx__started)
+#else
+#define CTX_TIME_BEGIN()
+#define CTX_TIME_END(operation)
+#endif
+
+#ifdef CTX_ENABLE_TRACE
+static void ctx__trace_record (ContextTraceType type, const void* context, const char* name, size_t value) {
+    if (global_trace_thread == 0) {
+        global_trace_thread = CTX_ATOMIC_FETCH_ADD (&global_trace_threads, (size_t)1) + 1;
+    }
+
+    size_t sequence          = CTX_ATOMIC_FETCH_ADD (&global_trace_head, (size_t)1);
+    ContextTraceEvent* event = &global_trace_events[sequence % CTX_TRACE_EVENTS];
+
+    CTX_ATOMIC_STORE (&event->sequence, (size_t)0);
+
+    event->timestamp = ctx__now ();
+    event->context   = context;
+    event->name      = name;
+    event->value     = value;
+    event->thread    = global_trace_thread;
+    event->type      = type;
+
+    CTX_ATOMIC_STORE (&event->sequence, sequence + 1);
+}
+
+#ifndef CTX_NO_REGISTRY
+#define CTX_TRACE(type, context, value) ctx__trace_record ((type), (context), (context)->name, (value))
+#else
+#define CTX_TRACE(type, context, value) ctx__trace_record ((type), (context), NULL, (value))
+#endif
+#else
+#define CTX_TRACE(type, context, value)
+#endif
+
+#ifdef CTX_ENABLE_FAULT_STATS
+// RUSAGE_THREAD needs _GNU_SOURCE, without it faults of every thread land in the touching context
+#ifdef RUSAGE_THREAD
+#define CTX_RUSAGE_WHO RUSAGE_THREAD
+#else
+#define CTX_RUSAGE_WHO RUSAGE_SELF
+#endif
+
+static void ctx__faults (size_t* minor, size_t* major) {
+    struct rusage usage;
+    getrusage (CTX_RUSAGE_WHO, &usage);
+
+    *minor = (size_t)usage.ru_minflt;
+    *major = (size_t)usage.ru_majflt;
+}
+
+// Writes to every page in [from, to) so first-touch faults are paid, and counted, here
+static void ctx__touch (Context* context, size_t from, size_t to) {
+    uintptr_t page_size = (uintptr_t)sysconf (_SC_PAGESIZE);
+    uintptr_t start     = (uintptr_t)context->buffer + from;
+    uintptr_t end       = (uintptr_t)context->buffer + to;
+    size_t minor, major, minor_after, major_after;
+
+    // The page holding from - 1 is already touched, only sample when the range leaves it
+    if (from > 0 && ((start - 1) & ~(page_size - 1)) == ((end - 1) & ~(page_size - 1))) {
+        return;
+    }
+
+    ctx__faults (&minor, &major);
+
+    for (uintptr_t page = start & ~(page_size - 1); page < end; page += page_size) {
+        *(volatile char*)(page < start ? start : page) = 0;
+    }
+
+    ctx__faults (&minor_after, &major_after);
+
+    context->stats.minor_faults += minor_after - minor;
+    context->stats.major_faults += major_after - major;
+}
+#endif
+
+#ifndef CTX_NO_REGISTRY
+// Registration and removal are rare, a spinlock keeps unlinking safe against concurrent reports
+static void ctx__registry_lock (void) {
+    while (!CTX_ATOMIC_CAS (&global_registry_lock, (size_t)0, (size_t)1)) {
+    }
+}
+
+static void ctx__registry_unlock (void) {
+    CTX_ATOMIC_STORE (&global_registry_lock, (size_t)0);
+}
+
+#ifdef CTX_ENABLE_PROFILE
+// Keeps the highest peak seen for a name, the registry lock must be held
+static void ctx__profile_name (const Context* context) {
+    const char* name = context->name != NULL ? context->name : "unnamed";
+
+    for (size_t i = 0; i < CTX_REGISTRY_NAMES; i++) {
+        ContextProfileName* entry = &global_profile_names[i];
+
+        if (entry->name == NULL) {
+            entry->name = name;
+        } else if (strcmp (entry->name, name) != 0) {
+            continue;
+        }
+
+        if (context->stats.peak > entry->peak) {
+            entry->peak = context->stats.peak;
+        }
+
+        return;
+    }
+}
+
+// Attributes an allocation to the site set by the calling macro, the site is consumed
+static void ctx__profile_record (const Context* context, size_t size) {
+    const char* file = global_profile_file;
+    int line         = file != NULL ? global_profile_line : 0;
+    size_t index     = (size_t)(((uintptr_t)file >> 3) * 31 + (size_t)line) % CTX_PROFILE_SITES;
+
+    global_profile_file = NULL;
+
+    ctx__registry_lock ();
+
+    for (size_t probe = 0; probe < CTX_PROFILE_SITES; probe++, index = (index + 1) % CTX_PROFILE_SITES) {
+        ContextProfileSite* site = &global_profile_sites[index];
+
+        if (site->allocations == 0) {
+            site->file = file;
+            site->line = line;
+        } else if (site->file != file || site->line != line) {
+            continue;
+        }
+
+        site->name = context->name != NULL ? context->name : "unnamed";
+        site->allocations++;
+        site->bytes += size;
+
+        if (size > site->largest) {
+            site->largest = size;
+        }
+
+        if (context->location > site->peak) {
+            site->peak = context->location;
+        }
+
+        ctx__registry_unlock ();
+        return;
+    }
+
+    global_profile_dropped++;
+
+    ctx__registry_unlock ();
+}
+#endif
+#endif // CTX_NO_REGISTRY
+
+#ifndef CTX_NO_CLEANUP
+// Runs every cleanup whose record lives at or above location, newest first
+static void ctx__run_cleanups (Context* context, size_t location) {
+    char* floor = (char*)context->buffer + location;
+
+    while (context->cleanups != NULL && (char*)context->cleanups >= floor) {
+        ContextCleanup* cleanup = context->cleanups;
+        context->cleanups       = cleanup->next;
+
+        if (cleanup->callback != NULL) {
+            cleanup->callback (cleanup->data);
+        }
+    }
+}
+#endif
+
+// Allocation boundaries form a bounded stack, the oldest entry is overwritten when full
+static void ctx__push_boundary (Context* context, size_t location) {
+#ifdef CTX_ENABLE_STATS
+    context->history_padding[context->history_head] = context->padding;
+#endif
+
+    context->history[context->history_head] = location;
+    context->history_head                    = (context->history_head + 1) % CTX_FORGET_DEPTH;
+
+    if (context->history_count < CTX_FORGET_DEPTH) {
+        context->history_count++;
+    }
+}
+
+static size_t ctx__top_boundary (const Context* context) {
+    return context->history[(context->history_head + CTX_FORGET_DEPTH - 1) % CTX_FORGET_DEPTH];
+}
+
+static void ctx__pop_boundary (Context* context) {
+    context->history_head = (context->history_head + CTX_FORGET_DEPTH - 1) % CTX_FORGET_DEPTH;
+    context->history_count--;
+}
+
+static void ctx__reset_boundaries (Context* context) {
+    context->history_head  = 0;
+    context->history_count = 0;
+}
+
+// Every reclaiming rewind starts a generation. A lower target supersedes the higher ones
+// before it, so a handle only needs the first target newer than its own generation
+static void ctx__next_generation (Context* context, size_t location) {
+    context->generation++;
+
+#ifndef CTX_NO_HANDLES
+    while (context->rewind_count > 0 && context->rewinds[context->rewind_count - 1] >= location) {
+        context->rewind_count--;
+    }
+
+    if (context->rewind_count == CTX_HANDLE_REWINDS) {
+        context->rewind_lost = context->rewind_generations[0];
+        context->rewind_count--;
+
+        memmove (context->rewinds, context->rewinds + 1, context->rewind_count * sizeof (size_t));
+        memmove (context->rewind_generations, context->rewind_generations + 1, context->rewind_count * sizeof (uint32_t));
+    }
+
+    context->rewinds[context->rewind_count]            = location;
+    context->rewind_generations[context->rewind_count] = context->generation;
+    context->rewind_count++;
+#else
+    (void)location;
+#endif
+}
+
+Context new_context (size_t size) {
+    CTX_TIME_BEGIN ();
+    Context ctx;
+
+#ifdef CTX_ENABLE_FAULT_STATS
+    size_t minor, major, minor_after, major_after;
+    ctx__faults (&minor, &major);
+#endif
+
+    ctx.buffer        = CTX_MALLOC (size);
+    ctx.location      = 0;
+    ctx.committed     = 0;
+    ctx.history_head  = 0;
+    ctx.history_count = 0;
+    ctx.size          = size;
+    ctx.floor         = 0;
+    ctx.depth         = 0;
+    ctx.generation    = 1;
+#ifndef CTX_NO_HANDLES
+    ctx.rewind_count = 0;
+    ctx.rewind_lost  = 0;
+#endif
+#ifndef CTX_NO_CLEANUP
+    ctx.cleanups = NULL;
+#endif
+#ifndef CTX_NO_BUDGET
+    ctx.budget = NULL;
+#endif
+#ifndef CTX_NO_REGISTRY
+    ctx.name          = NULL;
+    ctx.registry_next = NULL;
+    ctx.registered    = 0;
+#endif
+#ifdef CTX_ENABLE_STATS
+    ctx.padding = 0;
+    memset (&ctx.stats, 0, sizeof (ContextStats));
+#endif
+
+#ifdef CTX_ENABLE_FAULT_STATS
+    ctx__faults (&minor_after, &major_after);
+
+    ctx.stats.minor_faults = minor_after - minor;
+    ctx.stats.major_faults = major_after - major;
+#endif
+
+    CTX_TIME_END (CTX_OP_NEW);
+
+    return ctx;
+}
+
+#ifndef CTX_NO_BUDGET
+ContextBudget new_context_budget (const char* name, ContextBudget* parent, size_t soft_limit, size_t hard_limit) {
+    ContextBudget budget;
+
+    memset (&budget, 0, sizeof (ContextBudget));
+
+    budget.name       = name;
+    budget.parent     = parent;
+    budget.soft_limit = soft_limit;
+    budget.hard_limit = hard_limit;
+
+    return budget;
+}
+
+static void ctx__budget_release (ContextBudget* budget, ContextBudget* last, size_t size) {
+    for (; budget != last; budget = budget->parent) {
+        CTX_ATOMIC_FETCH_ADD (&budget->used, (size_t)0 - size);
+    }
+}
+
+// Returns the budget that rejected the charge, or NULL when every level accepted it
+static ContextBudget* ctx__budget_charge (ContextBudget* budget, size_t size) {
+    for (ContextBudget* level = budget; level != NULL; level = level->parent) {
+        size_t used = CTX_ATOMIC_FETCH_ADD (&level->used, size) + size;
+
+        if (level->hard_limit != 0 && used > level->hard_limit) {
+            ctx__budget_release (budget, level->parent, size);
+            return level;
+        }
+
+        if (level->soft_limit != 0 && used > level->soft_limit && used - size <= level->soft_limit && level->callback != NULL) {
+            level->callback (level, size, 0, level->user);
+        }
+
+        size_t peak = CTX_ATOMIC_LOAD (&level->peak);
+        while (used > peak && !CTX_ATOMIC_CAS (&level->peak, peak, used)) {
+            peak = CTX_ATOMIC_LOAD (&level->peak);
+        }
+    }
+
+    return NULL;
+}
+
+// On rejection the returned context has no buffer and a size of 0
+Context new_context_budgeted (size_t size, ContextBudget* budget) {
+    ContextBudget* rejected = ctx__budget_charge (budget, size);
+
+    // Give the owner of the full budget one chance to free memory (EG. trim caches)
+    if (rejected != NULL && rejected->callback != NULL) {
+        rejected->callback (rejected, size, 1, rejected->user);
+        rejected = ctx__budget_charge (budget, size);
+    }
+
+    if (rejected != NULL) {
+        CTX_ATOMIC_FETCH_ADD (&rejected->rejections, (size_t)1);
+        CTX_LOG ("[ERROR]: Budget \"%s\" rejected context of %zu bytes!\n", rejected->name, size);
+
+        Context ctx;
+
+        memset (&ctx, 0, sizeof (Context));
+        ctx.generation = 1;
+
+        return ctx;
+    }
+
+    Context ctx = new_context (size);
+    if (ctx.buffer == NULL) {
+        ctx__budget_release (budget, NULL, size);
+        ctx.size = 0;
+
+        return ctx;
+    }
+
+    ctx.budget = budget;
+
+    return ctx;
+}
+
+size_t context_budget_used (const ContextBudget* budget) {
+    return CTX_ATOMIC_LOAD (&budget->used);
+}
+#endif // CTX_NO_BUDGET
+
+void* context_alloc (Context* context, size_t size) {
+    return ctx__alloc (context, size, 1);
+}
+
+// Kept out of line so the inlined bump stays small
+static void* ctx__alloc_failed (Context* context, size_t size) {
+    CTX_TIME_BEGIN ();
+    (void)context;
+
+#ifdef CTX_ENABLE_STATS
+    context->stats.failures++;
+#endif
+
+    CTX_LOG ("[ERROR]: Static context unable to allocate %zu bytes!\n", size);
+    CTX_TRACE (CTX_TRACE_FAILURE, context, size);
+    CTX_PROBE2 (alloc__failed, context, size);
+
+#ifdef CTX_ENABLE_PROFILE
+    global_profile_file = NULL;
+#endif
+
+    CTX_TIME_END (CTX_OP_FAILURE);
+    return NULL;
+}
+
+CTX_INLINE void* ctx__alloc (Context* context, size_t size, size_t alignment) {
+    uintptr_t address = (uintptr_t)context->buffer + context->location;
+    size_t padding    = (size_t)(-address & (alignment - 1));
+
+    if (padding > context->size - context->location || size > context->size - context->location - padding) {
+        return ctx__alloc_failed (context, size);
+    }
+
+    ctx__push_boundary (context, context->location);
+
+    char* buffer_start = (char*)context->buffer;
+    void* chunk        = &buffer_start[context->location + padding];
+
+    context->location += padding + size;
+
+    if (context->location > context->committed) {
+#ifdef CTX_ENABLE_FAULT_STATS
+        ctx__touch (context, context->committed, context->location);
+#endif
+
+        context->committed = context->location;
+    }
+
+    CTX_TRACE (CTX_TRACE_ALLOC, context, context->location);
+    CTX_PROBE3 (alloc, context, size, context->location);
+
+#ifdef CTX_ENABLE_STATS
+    context->padding += padding;
+    context->stats.allocations++;
+    context->stats.allocated += size;
+
+    if (context->location > context->stats.peak) {
+        context->stats.peak = context->location;
+    }
+#endif
+
+#ifdef CTX_ENABLE_PROFILE
+    ctx__profile_record (context, size);
+#endif
+
+    return chunk;
+}
+
+CTX_INLINE void* ctx__alloc_array (Context* context, size_t size, size_t count, size_t alignment) {
+    if (count != 0 && size > SIZE_MAX / count) {
+        CTX_LOG ("[ERROR]: Allocation of %zu x %zu bytes overflows!\n", count, size);
+        return NULL;
+    }
+
+    return ctx__alloc (context, size * count, alignment);
+}
+
+void* context_alloc_aligned (Context* context, size_t size, size_t alignment) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        CTX_LOG ("[ERROR]: Alignment of %zu is not a power of two!\n", alignment);
+        return NULL;
+    }
+
+    return ctx__alloc (context, size, alignment);
+}
+
+void* context_alloc_array (Context* context, size_t size, size_t count, size_t alignment) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        CTX_LOG ("[ERROR]: Alignment of %zu is not a power of two!\n", alignment);
+        return NULL;
+    }
+
+    return ctx__alloc_array (context, size, count, alignment);
+}
+
+void* context_alloc_zeroed (Context* context, size_t size, size_t count, size_t alignment) {
+    void* chunk = context_alloc_array (context, size, count, alignment);
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    memset (chunk, 0, size * count);
+
+    return chunk;
+}
+
+// Lock-free bump for contexts shared between threads. It records no forget boundary, so
+// forget, rewind and transactions must wait until the other threads are done allocating
+void* context_alloc_atomic (Context* context, size_t size, size_t alignment) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        CTX_LOG ("[ERROR]: Alignment of %zu is not a power of two!\n", alignment);
+        return NULL;
+    }
+
+    size_t location = CTX_ATOMIC_LOAD (&context->location);
+    size_t padding;
+
+    for (;;) {
+        uintptr_t address = (uintptr_t)context->buffer + location;
+        padding           = (size_t)(-address & (alignment - 1));
+
+        if (padding > context->size - location || size > context->size - location - padding) {
+#ifdef CTX_ENABLE_STATS
+            CTX_ATOMIC_FETCH_ADD (&context->stats.failures, (size_t)1);
+#endif
+
+            CTX_LOG ("[ERROR]: Static context unable to allocate %zu bytes!\n", size);
+            CTX_TRACE (CTX_TRACE_FAILURE, context, size);
+            CTX_PROBE2 (alloc__failed, context, size);
+            return NULL;
+        }
+
+        if (CTX_ATOMIC_CAS (&context->location, location, location + padding + size)) {
+            break;
+        }
+
+        location = CTX_ATOMIC_LOAD (&context->location);
+    }
+
+    size_t end       = location + padding + size;
+    size_t committed = CTX_ATOMIC_LOAD (&context->committed);
+
+    while (end > committed && !CTX_ATOMIC_CAS (&context->committed, committed, end)) {
+        committed = CTX_ATOMIC_LOAD (&context->committed);
+    }
+
+    CTX_TRACE (CTX_TRACE_ALLOC, context, end);
+    CTX_PROBE3 (alloc, context, size, end);
+
+#ifdef CTX_ENABLE_STATS
+    CTX_ATOMIC_FETCH_ADD (&context->padding, padding);
+    CTX_ATOMIC_FETCH_ADD (&context->stats.allocations, (size_t)1);
+    CTX_ATOMIC_FETCH_ADD (&context->stats.allocated, size);
+
+    size_t peak = CTX_ATOMIC_LOAD (&context->stats.peak);
+
+    while (end > peak && !CTX_ATOMIC_CAS (&context->stats.peak, peak, end)) {
+        peak = CTX_ATOMIC_LOAD (&context->stats.peak);
+    }
+#endif
+
+    return (char*)context->buffer + location + padding;
+}
+
+#ifdef CTX_ENABLE_TAGS
+// Names are registered rarely, the lock only keeps two threads from claiming a name twice
+uint32_t context_tag (const char* name) {
+    while (!CTX_ATOMIC_CAS (&global_tag_lock, (size_t)0, (size_t)1)) {
+    }
+
+    size_t tag = 1;
+
+    while (tag < global_tag_count && strcmp (global_tag_names[tag], name) != 0) {
+        tag++;
+    }
+
+    if (tag == global_tag_count) {
+        if (tag < CTX_TAGS) {
+            global_tag_names[tag] = name;
+            CTX_ATOMIC_STORE (&global_tag_count, tag + 1);
+        } else {
+            CTX_LOG ("[ERROR]: No tag left for %s, counting it as tag 0!\n", name);
+            tag = 0;
+        }
+    }
+
+    CTX_ATOMIC_STORE (&global_tag_lock, (size_t)0);
+
+    return (uint32_t)tag;
+}
+
+void* context_alloc_tagged (Context* context, size_t size, size_t alignment, uint32_t tag) {
+    void* chunk = context_alloc_aligned (context, size, alignment);
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    if (global_tag_slot == 0) {
+        global_tag_slot = CTX_ATOMIC_FETCH_ADD (&global_tag_threads, (size_t)1) % CTX_TAG_THREADS + 1;
+    }
+
+    // Slots are only shared once threads outnumber CTX_TAG_THREADS, so these adds stay uncontended
+    size_t* counters = global_tag_counters[global_tag_slot - 1][tag < CTX_TAGS ? tag : 0];
+
+    CTX_ATOMIC_FETCH_ADD (&counters[0], (size_t)1);
+    CTX_ATOMIC_FETCH_ADD (&counters[1], size);
+
+    return chunk;
+}
+
+size_t context_tag_report (ContextTagUsage* usage, size_t capacity) {
+    size_t count = capacity < CTX_TAGS ? capacity : CTX_TAGS;
+
+    for (size_t tag = 0; tag < count; tag++) {
+        usage[tag].name        = tag < CTX_ATOMIC_LOAD (&global_tag_count) ? global_tag_names[tag] : NULL;
+        usage[tag].allocations = 0;
+        usage[tag].bytes       = 0;
+
+        for (size_t thread = 0; thread < CTX_TAG_THREADS; thread++) {
+            usage[tag].allocations += CTX_ATOMIC_LOAD (&global_tag_counters[thread][tag][0]);
+            usage[tag].bytes += CTX_ATOMIC_LOAD (&global_tag_counters[thread][tag][1]);
+        }
+    }
+
+    return count;
+}
+#endif
+
+size_t context_forget (Context* context) {
+    if (context->history_count == 0) {
+        CTX_LOG ("[ERROR]: Cannot forget last allocation!\n");
+        return 0;
+    }
+
+    if (ctx__top_boundary (context) < context->floor) {
+        CTX_LOG ("[ERROR]: Cannot forget past the start of a transaction!\n");
+        return 0;
+    }
+
+    return context_rewind (context, ctx__top_boundary (context));
+}
+
+size_t context_forget_n (Context* context, size_t count) {
+    size_t reverted = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (context->history_count == 0 || ctx__top_boundary (context) < context->floor) {
+            CTX_LOG ("[ERROR]: Cannot forget %zu of %zu allocations!\n", count - i, count);
+            break;
+        }
+
+        reverted += context_rewind (context, ctx__top_boundary (context));
+    }
+
+    return reverted;
+}
+
+size_t context_rewind (Context* context, size_t location) {
+    if (location > context->location) {
+        CTX_LOG ("[ERROR]: Cannot rewind static context forwards to %zu!\n", location);
+        return 0;
+    }
+
+    if (location < context->floor) {
+        CTX_LOG ("[ERROR]: Cannot rewind past the start of a transaction!\n");
+        return 0;
+    }
+
+#ifndef CTX_NO_CLEANUP
+    ctx__run_cleanups (context, location);
+#endif
+
+    size_t reverted   = context->location - location;
+    context->location = location;
+
+    if (reverted > 0) {
+        ctx__next_generation (context, location);
+    }
+
+    CTX_TRACE (CTX_TRACE_REWIND, context, location);
+    CTX_PROBE3 (rewind, context, location, reverted);
+
+#ifdef CTX_ENABLE_STATS
+    // Exact when location is still in the history, an upper bound otherwise
+    size_t padding = context->padding < location ? context->padding : location;
+#endif
+
+    while (context->history_count > 0 && ctx__top_boundary (context) >= location) {
+#ifdef CTX_ENABLE_STATS
+        if (ctx__top_boundary (context) == location) {
+            padding = context->history_padding[(context->history_head + CTX_FORGET_DEPTH - 1) % CTX_FORGET_DEPTH];
+        }
+#endif
+
+        ctx__pop_boundary (context);
+    }
+
+#ifdef CTX_ENABLE_STATS
+    context->padding = padding;
+#endif
+
+    return reverted;
+}
+
+#ifndef CTX_NO_CLEANUP
+// The record joins the previous allocation rather than becoming a forget boundary, so forgetting
+// the deferred object also reverts its record. Prefer context_alloc_with_cleanup for new chunks
+int context_defer (Context* context, ContextCleanupFn callback, void* data) {
+    size_t head     = context->history_head;
+    size_t count    = context->history_count;
+    size_t boundary = context->history[head];
+#ifdef CTX_ENABLE_STATS
+    size_t padding = context->history_padding[head];
+#endif
+
+    ContextCleanup* cleanup = (ContextCleanup*)context_alloc_aligned (context, sizeof (ContextCleanup), CTX_ALIGNOF (ContextCleanup));
+    if (cleanup == NULL) {
+        return 0;
+    }
+
+    context->history[head] = boundary;
+    context->history_head  = head;
+    context->history_count = count;
+#ifdef CTX_ENABLE_STATS
+    context->history_padding[head] = padding;
+#endif
+
+    cleanup->callback = callback;
+    cleanup->data     = data;
+    cleanup->next     = context->cleanups;
+    context->cleanups = cleanup;
+
+    return 1;
+}
+
+// The record and the chunk form one allocation, record first, so a single forget reverts
+// both. The record is linked with no callback, set it once the chunk is initialised
+void* context_alloc_with_cleanup (Context* context, size_t size, size_t alignment, ContextCleanup** cleanup) {
+    size_t record_alignment = CTX_ALIGNOF (ContextCleanup);
+    size_t offset           = (sizeof (ContextCleanup) + alignment - 1) & ~(alignment - 1);
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        CTX_LOG ("[ERROR]: Alignment of %zu is not a power of two!\n", alignment);
+        return NULL;
+    }
+
+    if (size > SIZE_MAX - offset) {
+        CTX_LOG ("[ERROR]: Allocation of %zu bytes overflows!\n", size);
+        return NULL;
+    }
+
+    char* block = (char*)context_alloc_aligned (context, offset + size, alignment > record_alignment ? alignment : record_alignment);
+    if (block == NULL) {
+        return NULL;
+    }
+
+    ContextCleanup* record = (ContextCleanup*)block;
+    record->callback       = NULL;
+    record->data           = NULL;
+    record->next           = context->cleanups;
+    context->cleanups      = record;
+
+    *cleanup = record;
+
+    return block + offset;
+}
+#endif
+
+void* context_promote (Context* context, const void* data, size_t size, size_t alignment) {
+    void* chunk = context_alloc_aligned (context, size, alignment);
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    memcpy (chunk, data, size);
+
+    return chunk;
+}
+
+void* context_promote_array (Context* context, const void* data, size_t size, size_t count, size_t alignment) {
+    void* chunk = context_alloc_array (context, size, count, alignment);
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    memcpy (chunk, data, size * count);
+
+    return chunk;
+}
+
+// Copies every item with a single allocation, items are replaced with their copies
+int context_promote_many (Context* context, void** items, const size_t* sizes, size_t count, size_t alignment) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        CTX_LOG ("[ERROR]: Alignment of %zu is not a power of two!\n", alignment);
+        return 0;
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t padded = (sizes[i] + alignment - 1) & ~(alignment - 1);
+
+        if (padded < sizes[i] || total + padded < total) {
+            CTX_LOG ("[ERROR]: Promotion of %zu allocations overflows!\n", count);
+            return 0;
+        }
+
+        total += padded;
+    }
+
+    char* chunk = (char*)context_alloc_aligned (context, total, alignment);
+    if (chunk == NULL) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        memcpy (chunk, items[i], sizes[i]);
+
+        items[i] = chunk;
+        chunk += (sizes[i] + alignment - 1) & ~(alignment - 1);
+    }
+
+    return 1;
+}
+
+// Keeps the copy at the same offset modulo CTX_MAX_ALIGNMENT so objects stay aligned
+void* context_promote_range (Context* context, const Context* source, size_t from, size_t to) {
+    if (from > to || to > source->location) {
+        CTX_LOG ("[ERROR]: Cannot promote range %zu-%zu of %zu used bytes!\n", from, to, source->location);
+        return NULL;
+    }
+
+    const char* data = (const char*)source->buffer + from;
+    size_t skew      = (size_t)((uintptr_t)data & (CTX_MAX_ALIGNMENT - 1));
+
+    if (to - from > SIZE_MAX - skew) {
+        CTX_LOG ("[ERROR]: Promotion of %zu bytes overflows!\n", to - from);
+        return NULL;
+    }
+
+    char* chunk = (char*)context_alloc_aligned (context, skew + (to - from), CTX_MAX_ALIGNMENT);
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    memcpy (chunk + skew, data, to - from);
+
+    return chunk + skew;
+}
+
+// Anything the callback allocated is rolled back if it fails
+void* context_promote_deep (Context* context, const void* data, ContextPromoteFn callback, void* user) {
+    ContextTransaction transaction = context_begin (context);
+
+    void* result = callback (context, data, user);
+    if (result == NULL) {
+        context_rollback (context, &transaction);
+        return NULL;
+    }
+
+    context_commit (context, &transaction);
+
+    return result;
+}
+
+ContextTransaction context_begin (Context* context) {
+    ContextTransaction transaction;
+
+    transaction.location = context->location;
+    transaction.floor    = context->floor;
+    transaction.depth    = ++context->depth;
+#ifdef CTX_ENABLE_STATS
+    transaction.padding = context->padding;
+#endif
+
+    // Forgetting inside the transaction must not reach data from before it
+    context->floor = context->location;
+
+    return transaction;
+}
+
+int context_commit (Context* context, ContextTransaction* transaction) {
+    if (transaction->depth != context->depth) {
+        CTX_LOG ("[ERROR]: Transaction %zu committed out of order!\n", transaction->depth);
+        return 0;
+    }
+
+    context->floor = transaction->floor;
+    context->depth--;
+
+    return 1;
+}
+
+size_t context_rollback (Context* context, ContextTransaction* transaction) {
+    if (transaction->depth != context->depth) {
+        CTX_LOG ("[ERROR]: Transaction %zu rolled back out of order!\n", transaction->depth);
+        return 0;
+    }
+
+    size_t reverted = context_rewind (context, transaction->location);
+
+    context->floor = transaction->floor;
+    context->depth--;
+
+#ifdef CTX_ENABLE_STATS
+    context->padding = transaction->padding;
+#endif
+
+    return reverted;
+}
+
+#ifndef CTX_NO_STR
+char* context_alloc_cstring (Context* context, const char* str) {
+    size_t string_length = strlen (str);
+
+    char* chunk = (char*)context_alloc (context, string_length + 1);
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    strcpy (chunk, str);
+
+    return chunk;
+}
+
+char* context_alloc_cstringf (Context* context, const char* fmt, ...) {
+    va_list args;
+    va_start (args, fmt);
+
+    va_list args_copy;
+    va_copy (args_copy, args);
+    int formatted = vsnprintf (NULL, 0, fmt, args_copy);
+    va_end (args_copy);
+
+    // Failing before the allocation keeps a bad format from leaving an unreachable block behind
+    if (formatted < 0) {
+        CTX_LOG ("[ERROR]: Unable to format string!\n");
+        va_end (args);
+        return NULL;
+    }
+
+    size_t string_length = (size_t)formatted + 1;
+
+    char* buffer = (char*)context_alloc (context, string_length);
+    if (buffer == NULL) {
+        va_end (args);
+        return NULL;
+    }
+
+    vsnprintf (buffer, string_length, fmt, args);
+    va_end (args);
+
+    return buffer;
+}
+#endif
+
+void context_clear (Context* context) {
+    CTX_TIME_BEGIN ();
+    CTX_PROBE2 (clear, context, context->location);
+
+#ifndef CTX_NO_CLEANUP
+    ctx__run_cleanups (context, 0);
+#endif
+
+    ctx__reset_boundaries (context);
+
+    context->location = 0;
+    context->floor    = 0;
+    context->depth    = 0;
+    ctx__next_generation (context, 0);
+
+#ifdef CTX_ENABLE_STATS
+    context->padding = 0;
+#endif
+
+    CTX_TRACE (CTX_TRACE_CLEAR, context, 0);
+    CTX_TIME_END (CTX_OP_CLEAR);
+}
+
+void context_free (Context* context) {
+    CTX_TIME_BEGIN ();
+    CTX_PROBE2 (free, context, context->size);
+
+#ifndef CTX_NO_CLEANUP
+    ctx__run_cleanups (context, 0);
+#endif
+
+    ctx__reset_boundaries (context);
+
+#ifndef CTX_NO_REGISTRY
+    context_unregister (context);
+#endif
+
+#ifndef CTX_NO_BUDGET
+    if (context->budget != NULL) {
+        ctx__budget_release (context->budget, NULL, context->size);
+        context->budget = NULL;
+    }
+#endif
+
+    context->location  = 0;
+    context->committed = 0;
+    context->size      = 0;
+    context->floor     = 0;
+    context->depth     = 0;
+    ctx__next_generation (context, 0);
+
+#ifdef CTX_ENABLE_STATS
+    context->padding = 0;
+#endif
+
+    CTX_FREE (context->buffer);
+
+    CTX_TRACE (CTX_TRACE_FREE, context, 0);
+    CTX_TIME_END (CTX_OP_FREE);
+}
+
+// Returns the unused pages of a context to the OS, they read back as zero when touched again.
+// Only call it from the thread that allocates from the context: a concurrent bump into the
+// pages being released loses its writes
+size_t context_decommit (Context* context) {
+#if (defined(__unix__) || defined(__APPLE__)) && defined(MADV_DONTNEED)
+    if (context->buffer == NULL) {
+        return 0;
+    }
+
+    uintptr_t page_size = (uintptr_t)sysconf (_SC_PAGESIZE);
+    uintptr_t start     = (uintptr_t)context->buffer + context->location;
+    uintptr_t end       = (uintptr_t)context->buffer + context->size;
+
+    start = (start + page_size - 1) & ~(page_size - 1);
+    end   = end & ~(page_size - 1);
+
+    if (start >= end) {
+        return 0;
+    }
+
+    CTX_TIME_BEGIN ();
+
+    if (madvise ((void*)start, end - start, MADV_DONTNEED) != 0) {
+        CTX_LOG ("[ERROR]: Unable to decommit %zu bytes of static context!\n", (size_t)(end - start));
+        return 0;
+    }
+
+    CTX_TIME_END (CTX_OP_DECOMMIT);
+
+    if (context->committed > start - (uintptr_t)context->buffer) {
+        context->committed = (size_t)(start - (uintptr_t)context->buffer);
+    }
+
+    return (size_t)(end - start);
+#elif defined(__unix__) || defined(__APPLE__)
+    (void)context;
+    CTX_LOG ("[ERROR]: Decommit needs madvise, define _DEFAULT_SOURCE in strict ISO C builds!\n");
+    return 0;
+#else
+    (void)context;
+    return 0;
+#endif
+}
+
+#ifdef CTX_ENABLE_STATS
+ContextFragmentation context_fragmentation (const Context* context) {
+    ContextFragmentation report;
+
+    report.reserved    = context->size;
+    report.used        = context->location;
+    report.padding     = context->padding < context->location ? context->padding : context->location;
+    report.requested   = report.used - report.padding;
+    report.slack       = context->committed > context->location ? context->committed - context->location : 0;
+    report.tail        = context->size - context->location - report.slack;
+    report.utilization = report.used > 0 ? (double)report.requested / (double)report.used : 1.0;
+
+    return report;
+}
+
+void context_fragmentation_log (const Context* context) {
+    ContextFragmentation report = context_fragmentation (context);
+    const char* name            = "unnamed";
+
+#ifndef CTX_NO_REGISTRY
+    if (context->name != NULL) {
+        name = context->name;
+    }
+#endif
+
+    CTX_LOG ("[FRAGMENTATION]: %s reserved %zu, used %zu (requested %zu, padding %zu), slack %zu, tail %zu, "
+             "utilization %.1f%%\n",
+             name, report.reserved, report.used, report.requested, report.padding, report.slack, report.tail,
+             report.utilization * 100.0);
+}
+#endif
+
+#ifdef CTX_ENABLE_FAULT_STATS
+size_t context_resident (const Context* context) {
+    if (context->buffer == NULL || context->size == 0) {
+        return 0;
+    }
+
+    uintptr_t page_size = (uintptr_t)sysconf (_SC_PAGESIZE);
+    uintptr_t start     = (uintptr_t)context->buffer & ~(page_size - 1);
+    uintptr_t end       = (uintptr_t)context->buffer + context->size;
+    size_t resident     = 0;
+
+#ifdef __APPLE__
+    char pages[256];
+#else
+    unsigned char pages[256];
+#endif
+
+    while (start < end) {
+        size_t count = (size_t)((end - start + page_size - 1) / page_size);
+        if (count > sizeof (pages)) {
+            count = sizeof (pages);
+        }
+
+        if (mincore ((void*)start, count * page_size, pages) != 0) {
+            CTX_LOG ("[ERROR]: Unable to query resident pages of static context!\n");
+            return resident;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            resident += (pages[i] & 1) ? page_size : 0;
+        }
+
+        start += count * page_size;
+    }
+
+    return resident;
+}
+#endif
+
+#ifndef CTX_NO_TEMP
+static Context* ctx__temp_context (void) {
+    if (global_temp_context.size == 0) {
+        global_temp_context = new_context (CTX_TEMP_SIZE);
+
+#ifndef CTX_NO_REGISTRY
+        context_register (&global_temp_context, "temp");
+#endif
+    }
+
+    return &global_temp_context;
+}
+
+void* context_talloc (size_t size) {
+    CTX_PROBE1 (talloc, size);
+
+    return context_alloc (ctx__temp_context (), size);
+}
+
+#ifdef CTX_ENABLE_TAGS
+void* context_talloc_tagged (size_t size, uint32_t tag) {
+    CTX_PROBE1 (talloc, size);
+
+    return context_alloc_tagged (ctx__temp_context (), size, 1, tag);
+}
+#endif
+
+size_t context_tforget (void) {
+    CTX_PROBE1 (tforget, global_temp_context.location);
+
+    return context_forget (&global_temp_context);
+}
+
+#ifndef CTX_NO_STR
+char* context_talloc_cstring (const char* str) {
+    return context_alloc_cstring (ctx__temp_context (), str);
+}
+
+char* context_talloc_cstringf (const char* fmt, ...) {
+    Context* context = ctx__temp_context ();
+
+    va_list args;
+    va_start (args, fmt);
+
+    va_list args_copy;
+    va_copy (args_copy, args);
+    int formatted = vsnprintf (NULL, 0, fmt, args_copy);
+    va_end (args_copy);
+
+    // Failing before the allocation keeps a bad format from leaving an unreachable block behind
+    if (formatted < 0) {
+        CTX_LOG ("[ERROR]: Unable to format string!\n");
+        va_end (args);
+        return NULL;
+    }
+
+    size_t string_length = (size_t)formatted + 1;
+
+    char* buffer = (char*)context_alloc (context, string_length);
+    if (buffer == NULL) {
+        va_end (args);
+        return NULL;
+    }
+
+    vsnprintf (buffer, string_length, fmt, args);
+    va_end (args);
+
+    return buffer;
+}
+#endif
+
+void context_tclear (void) {
+    CTX_PROBE1 (tclear, global_temp_context.location);
+
+    context_clear (&global_temp_context);
+}
+
+void context_tfree (void) {
+    CTX_PROBE1 (tfree, global_temp_context.size);
+
+    context_free (&global_temp_context);
+}
+
+// Shrinks the temp context and the calling thread's scratch contexts down to what is in use.
+// The temp context is shared, so no other thread may be using it during the call
+size_t context_tdecommit (void) {
+    size_t decommitted = context_decommit (&global_temp_context);
+
+    for (size_t i = 0; i < CTX_SCRATCH_COUNT; i++) {
+        decommitted += context_decommit (&global_scratch_contexts[i]);
+    }
+
+    return decommitted;
+}
+
+// Returns a scratch context of the calling thread that is not in conflicts
+ContextScratch context_get_scratch (Context** conflicts, size_t count) {
+    ContextScratch scratch = {NULL, 0};
+
+    for (size_t i = 0; i < CTX_SCRATCH_COUNT; i++) {
+        Context* candidate = &global_scratch_contexts[i];
+        int in_use         = 0;
+
+        for (size_t j = 0; j < count; j++) {
+            if (conflicts[j] == candidate) {
+                in_use = 1;
+                break;
+            }
+        }
+
+        if (in_use) {
+            continue;
+        }
+
+        if (candidate->size == 0) {
+            *candidate = new_context (CTX_SCRATCH_SIZE);
+        }
+
+        scratch.context  = candidate;
+        scratch.location = candidate->location;
+
+        return scratch;
+    }
+
+    CTX_LOG ("[ERROR]: All %d scratch contexts conflict!\n", (int)CTX_SCRATCH_COUNT);
+    return scratch;
+}
+
+void context_release_scratch (ContextScratch* scratch) {
+    if (scratch->context == NULL) {
+        return;
+    }
+
+    context_rewind (scratch->context, scratch->location);
+    scratch->context = NULL;
+}
+
+void context_free_scratch (void) {
+    for (size_t i = 0; i < CTX_SCRATCH_COUNT; i++) {
+        if (global_scratch_contexts[i].size != 0) {
+            context_free (&global_scratch_contexts[i]);
+        }
+    }
+}
+#endif // CTX_NO_TEMP
+
+#ifndef CTX_NO_GC
+#define CTX_GC_ROUND(x) (((x) + CTX_MAX_ALIGNMENT - 1) & ~(size_t)(CTX_MAX_ALIGNMENT - 1))
+#define CTX_GC_HEADER_SIZE CTX_GC_ROUND (sizeof (ContextGCHeader))
+
+// Records are always a multiple of CTX_MAX_ALIGNMENT so a context can be walked linearly
+void* context_gc_alloc (Context* context, const ContextGCType* type, size_t size) {
+    if (size > SIZE_MAX - CTX_GC_HEADER_SIZE - CTX_MAX_ALIGNMENT) {
+        CTX_LOG ("[ERROR]: Collectable allocation of %zu bytes overflows!\n", size);
+        return NULL;
+    }
+
+    char* record = (char*)context_alloc_aligned (context, CTX_GC_HEADER_SIZE + CTX_GC_ROUND (size), CTX_MAX_ALIGNMENT);
+    if (record == NULL) {
+        return NULL;
+    }
+
+    ContextGCHeader* header = (ContextGCHeader*)record;
+    header->type            = type;
+    header->size            = size;
+    header->forward         = NULL;
+
+    return record + CTX_GC_HEADER_SIZE;
+}
+
+// Pointers that do not point into the used part of the from context are left alone
+void context_gc_visit (ContextGC* gc, void** slot) {
+    char* object = (char*)*slot;
+    char* start  = (char*)gc->from->buffer;
+
+    if (object == NULL || object < start + CTX_GC_HEADER_SIZE || object >= start + gc->from->location) {
+        return;
+    }
+
+    ContextGCHeader* header = (ContextGCHeader*)(object - CTX_GC_HEADER_SIZE);
+    if (header->forward == NULL) {
+        void* copy = context_gc_alloc (gc->to, header->type, header->size);
+
+        memcpy (copy, object, header->size);
+        header->forward = copy;
+        gc->copied += CTX_GC_HEADER_SIZE + CTX_GC_ROUND (header->size);
+    }
+
+    *slot = header->forward;
+}
+
+// Copies everything reachable from roots into to and clears from, returns the live bytes
+size_t context_gc_collect (Context* from, Context* to, void** roots[], size_t count) {
+    CTX_TIME_BEGIN ();
+
+    uintptr_t scan = (uintptr_t)to->buffer + to->location;
+    scan           = (scan + CTX_MAX_ALIGNMENT - 1) & ~(uintptr_t)(CTX_MAX_ALIGNMENT - 1);
+
+    // Live data can never exceed what is used in from, so copying cannot fail halfway
+    if ((uintptr_t)to->buffer + to->size < scan || (uintptr_t)to->buffer + to->size - scan < from->location) {
+        CTX_LOG ("[ERROR]: Collection needs %zu free bytes in the target context!\n", from->location);
+        return 0;
+    }
+
+    ContextGC gc;
+    gc.from   = from;
+    gc.to     = to;
+    gc.copied = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        context_gc_visit (&gc, roots[i]);
+    }
+
+    // Cheney scan, objects between scan and the end of to still need their fields forwarded
+    while (scan < (uintptr_t)to->buffer + to->location) {
+        ContextGCHeader* header = (ContextGCHeader*)scan;
+        void* object            = (char*)header + CTX_GC_HEADER_SIZE;
+
+        if (header->type != NULL && header->type->trace != NULL) {
+            header->type->trace (&gc, object);
+        }
+
+        scan += CTX_GC_HEADER_SIZE + CTX_GC_ROUND (header->size);
+    }
+
+    context_clear (from);
+
+    CTX_TIME_END (CTX_OP_COLLECT);
+
+    return gc.copied;
+}
+#endif // CTX_NO_GC
+
+#ifndef CTX_NO_SHARED
+// Takes ownership of context, leaving the original empty. Starts with one reference
+ContextShared* context_share (Context* context, ContextReleaseFn release, void* user) {
+    ContextShared* shared = (ContextShared*)CTX_MALLOC (sizeof (ContextShared));
+    if (shared == NULL) {
+        CTX_LOG ("[ERROR]: Unable to allocate shared context!\n");
+        return NULL;
+    }
+
+    shared->context    = *context;
+    shared->references = 1;
+    shared->release    = release;
+    shared->user       = user;
+
+#ifndef CTX_NO_REGISTRY
+    if (context->registered) {
+        context_unregister (context);
+        shared->context.registered = 0;
+        context_register (&shared->context, context->name);
+    }
+#endif
+
+    // The original is left empty as new_context (0) would make it, its cleanups now belong to
+    // the shared copy. The generation still moves on so handles into the moved buffer go stale
+    uint32_t generation = context->generation;
+
+    memset (context, 0, sizeof (Context));
+    context->generation = generation;
+    ctx__next_generation (context, 0);
+
+    return shared;
+}
+
+ContextShared* context_retain (ContextShared* shared) {
+    CTX_ATOMIC_FETCH_ADD (&shared->references, (size_t)1);
+
+    return shared;
+}
+
+// The last release frees the context, or hands it to the release callback (EG. a pool)
+void context_release (ContextShared* shared) {
+    if (CTX_ATOMIC_FETCH_ADD (&shared->references, (size_t)-1) != 1) {
+        return;
+    }
+
+    if (shared->release != NULL) {
+#ifndef CTX_NO_REGISTRY
+        // The registry must not keep a node that is freed below
+        context_unregister (&shared->context);
+#endif
+
+        shared->release (&shared->context, shared->user);
+    } else {
+        context_free (&shared->context);
+    }
+
+    CTX_FREE (shared);
+}
+#endif // CTX_NO_SHARED
+
+#ifndef CTX_NO_EPOCH
+// A size of 0 only tracks readers, EG. for a ContextSnapshot
+int context_epoch_init (ContextEpoch* manager, size_t size) {
+    memset (manager, 0, sizeof (ContextEpoch));
+
+    if (size == 0) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < 3; i++) {
+        manager->contexts[i] = new_context (size);
+
+        if (manager->contexts[i].buffer == NULL) {
+            CTX_LOG ("[ERROR]: Unable to create epoch context of %zu bytes!\n", size);
+            context_epoch_free (manager);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void context_epoch_free (ContextEpoch* manager) {
+    for (size_t i = 0; i < 3; i++) {
+        if (manager->contexts[i].size != 0) {
+            context_free (&manager->contexts[i]);
+        }
+    }
+}
+
+ContextEpochReader* context_epoch_register (ContextEpoch* manager) {
+    for (size_t i = 0; i < CTX_EPOCH_READERS; i++) {
+        if (CTX_ATOMIC_CAS (&manager->readers[i].claimed, (size_t)0, (size_t)1)) {
+            return &manager->readers[i];
+        }
+    }
+
+    CTX_LOG ("[ERROR]: All %d epoch readers are registered!\n", (int)CTX_EPOCH_READERS);
+    return NULL;
+}
+
+void context_epoch_unregister (ContextEpochReader* reader) {
+    CTX_ATOMIC_STORE (&reader->state, (size_t)0);
+    CTX_ATOMIC_STORE (&reader->claimed, (size_t)0);
+}
+
+// Wait-free unless the epoch moves while entering, the state is republished until it is stable
+void context_epoch_enter (ContextEpoch* manager, ContextEpochReader* reader) {
+    size_t epoch = CTX_ATOMIC_LOAD (&manager->epoch);
+
+    for (;;) {
+        CTX_ATOMIC_STORE (&reader->state, (epoch << 1) | 1);
+
+        size_t current = CTX_ATOMIC_LOAD (&manager->epoch);
+        if (current == epoch) {
+            return;
+        }
+
+        epoch = current;
+    }
+}
+
+void context_epoch_exit (ContextEpochReader* reader) {
+    CTX_ATOMIC_STORE (&reader->state, (size_t)0);
+}
+
+// Writers must be serialised by the caller, nodes go to the current epoch's context. They are
+// reclaimed two advances later even if still linked, so live nodes must be copied forward
+void* context_epoch_alloc (ContextEpoch* manager, size_t size, size_t alignment) {
+    size_t epoch = CTX_ATOMIC_LOAD (&manager->epoch);
+
+    return context_alloc_aligned (&manager->contexts[epoch % 3], size, alignment);
+}
+
+// Fails while a reader is still in an older epoch, otherwise clears everything allocated in epoch - 1
+int context_epoch_advance (ContextEpoch* manager) {
+    size_t epoch = CTX_ATOMIC_LOAD (&manager->epoch);
+
+    for (size_t i = 0; i < CTX_EPOCH_READERS; i++) {
+        size_t state = CTX_ATOMIC_LOAD (&manager->readers[i].state);
+
+        if ((state & 1) != 0 && (state >> 1) != epoch) {
+            return 0;
+        }
+    }
+
+    CTX_ATOMIC_STORE (&manager->epoch, epoch + 1);
+
+    if (manager->contexts[(epoch + 2) % 3].size != 0) {
+        context_clear (&manager->contexts[(epoch + 2) % 3]);
+    }
+
+    return 1;
+}
+
+// Readers and the publisher share epoch, which may also be used for other structures
+void context_snapshot_init (ContextSnapshot* snapshot, ContextEpoch* epoch) {
+    memset (snapshot, 0, sizeof (ContextSnapshot));
+
+    snapshot->epoch = epoch;
+}
+
+// Must only be called once no reader can access the snapshot
+void context_snapshot_free (ContextSnapshot* snapshot) {
+    Context* contexts[3] = {&snapshot->current, &snapshot->retired, &snapshot->spare};
+
+    for (size_t i = 0; i < 3; i++) {
+        if (contexts[i]->size != 0) {
+            context_free (contexts[i]);
+        }
+    }
+
+    snapshot->root = NULL;
+}
+
+// Hands back the reclaimed previous version for reuse when possible
+Context context_snapshot_build (ContextSnapshot* snapshot, size_t size) {
+    context_snapshot_reclaim (snapshot);
+
+    if (snapshot->spare.size >= size) {
+        Context context = snapshot->spare;
+        memset (&snapshot->spare, 0, sizeof (Context));
+
+        return context;
+    }
+
+    return new_context (size);
+}
+
+// Returns 1 and takes ownership of next, leaving it empty. Returns 0 while the previous retired
+// version is still being read, next is then untouched and still owned (and freed) by the caller
+int context_snapshot_publish (ContextSnapshot* snapshot, Context* next, void* root) {
+    if (!context_snapshot_reclaim (snapshot)) {
+        return 0;
+    }
+
+    CTX_ATOMIC_STORE (&snapshot->root, root);
+
+    snapshot->retired       = snapshot->current;
+    snapshot->retired_epoch = CTX_ATOMIC_LOAD (&snapshot->epoch->epoch);
+    snapshot->current       = *next;
+
+    memset (next, 0, sizeof (Context));
+
+    return 1;
+}
+
+// Readers that could see the retired root entered by retired_epoch, two advances prove they left
+int context_snapshot_reclaim (ContextSnapshot* snapshot) {
+    if (snapshot->retired.size == 0) {
+        return 1;
+    }
+
+    while (CTX_ATOMIC_LOAD (&snapshot->epoch->epoch) < snapshot->retired_epoch + 2) {
+        if (!context_epoch_advance (snapshot->epoch)) {
+            return 0;
+        }
+    }
+
+    if (snapshot->spare.size != 0) {
+        context_free (&snapshot->spare);
+    }
+
+    context_clear (&snapshot->retired);
+
+    snapshot->spare = snapshot->retired;
+    memset (&snapshot->retired, 0, sizeof (Context));
+
+    return 1;
+}
+
+void* context_snapshot_acquire (ContextSnapshot* snapshot, ContextEpochReader* reader) {
+    context_epoch_enter (snapshot->epoch, reader);
+
+    return (void*)CTX_ATOMIC_LOAD (&snapshot->root);
+}
+
+void context_snapshot_release (ContextEpochReader* reader) {
+    context_epoch_exit (reader);
+}
+#endif // CTX_NO_EPOCH
+
+#ifndef CTX_NO_REGISTRY
+// The context must stay at the same address until it is freed or unregistered
+void context_register (Context* context, const char* name) {
+    if (context->registered) {
+        context->name = name;
+        return;
+    }
+
+    ctx__registry_lock ();
+
+    context->name          = name;
+    context->registry_next = global_registry_head;
+    context->registered    = 1;
+    global_registry_head   = context;
+
+    ctx__registry_unlock ();
+}
+
+void context_unregister (Context* context) {
+    if (!context->registered) {
+        return;
+    }
+
+    ctx__registry_lock ();
+
+#ifdef CTX_ENABLE_PROFILE
+    ctx__profile_name (context);
+#endif
+
+    for (Context** link = &global_registry_head; *link != NULL; link = &(*link)->registry_next) {
+        if (*link == context) {
+            *link = context->registry_next;
+            break;
+        }
+    }
+
+    context->registry_next = NULL;
+    context->registered    = 0;
+
+    ctx__registry_unlock ();
+}
+
+// Names past capacity are not stored, earlier contexts are searched so each counts once
+static int ctx__registry_seen (const Context* context, const char* name) {
+    for (const Context* other = global_registry_head; other != context; other = other->registry_next) {
+        if (strcmp (other->name != NULL ? other->name : "unnamed", name) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Totals per name, returns the number of distinct names which may be more than capacity
+size_t context_registry_report (ContextUsage* usage, size_t capacity) {
+    size_t names = 0;
+
+    ctx__registry_lock ();
+
+    for (Context* context = global_registry_head; context != NULL; context = context->registry_next) {
+        const char* name = context->name != NULL ? context->name : "unnamed";
+        size_t index     = 0;
+
+        while (index < names && index < capacity && strcmp (usage[index].name, name) != 0) {
+            index++;
+        }
+
+        if (index == names && index < capacity) {
+            names++;
+
+            memset (&usage[index], 0, sizeof (ContextUsage));
+            usage[index].name = name;
+        } else if (index == capacity && !ctx__registry_seen (context, name)) {
+            names++;
+        }
+
+        if (index < capacity) {
+            usage[index].contexts++;
+            usage[index].reserved += CTX_ATOMIC_LOAD (&context->size);
+            usage[index].committed += CTX_ATOMIC_LOAD (&context->committed);
+            usage[index].used += CTX_ATOMIC_LOAD (&context->location);
+
+#ifdef CTX_ENABLE_STATS
+            usage[index].padding += CTX_ATOMIC_LOAD (&context->padding);
+            usage[index].stats.allocations += CTX_ATOMIC_LOAD (&context->stats.allocations);
+            usage[index].stats.allocated += CTX_ATOMIC_LOAD (&context->stats.allocated);
+            usage[index].stats.failures += CTX_ATOMIC_LOAD (&context->stats.failures);
+            usage[index].stats.peak += CTX_ATOMIC_LOAD (&context->stats.peak);
+#endif
+
+#ifdef CTX_ENABLE_FAULT_STATS
+            usage[index].stats.minor_faults += CTX_ATOMIC_LOAD (&context->stats.minor_faults);
+            usage[index].stats.major_faults += CTX_ATOMIC_LOAD (&context->stats.major_faults);
+            usage[index].resident += context_resident (context);
+#endif
+        }
+    }
+
+    ctx__registry_unlock ();
+
+    return names;
+}
+
+void context_registry_log (void) {
+    ContextUsage usage[CTX_REGISTRY_NAMES];
+    size_t names = context_registry_report (usage, CTX_REGISTRY_NAMES);
+
+    CTX_LOG ("[REGISTRY]: %-24s %8s %12s %12s %12s\n", "name", "contexts", "reserved", "committed", "used");
+
+    for (size_t i = 0; i < names && i < CTX_REGISTRY_NAMES; i++) {
+        CTX_LOG ("[REGISTRY]: %-24s %8zu %12zu %12zu %12zu\n", usage[i].name, usage[i].contexts, usage[i].reserved,
+                 usage[i].committed, usage[i].used);
+    }
+
+    if (names > CTX_REGISTRY_NAMES) {
+        CTX_LOG ("[REGISTRY]: %zu more names not shown\n", names - CTX_REGISTRY_NAMES);
+    }
+}
+
+#ifdef CTX_ENABLE_PROFILE
+void context_profile_site (const char* file, int line) {
+    global_profile_file = file;
+    global_profile_line = line;
+}
+
+void context_profile_reset (void) {
+    ctx__registry_lock ();
+
+    memset (global_profile_sites, 0, sizeof (global_profile_sites));
+    memset (global_profile_names, 0, sizeof (global_profile_names));
+    global_profile_dropped = 0;
+
+    ctx__registry_unlock ();
+}
+
+// Peak plus headroom, rounded up to whole 4KB pages
+static size_t ctx__profile_recommend (size_t peak, double headroom) {
+    double padded = (double)peak * (1.0 + (headroom > 0.0 ? headroom : 0.0));
+    size_t size   = (size_t)padded + 4095;
+
+    return size < 4096 ? 4096 : size - size % 4096;
+}
+
+size_t context_profile_fwrite_header (FILE* file, double headroom) {
+    size_t written = 0;
+
+    ctx__registry_lock ();
+
+    // Live contexts have not reported their peak yet
+    for (Context* context = global_registry_head; context != NULL; context = context->registry_next) {
+        ctx__profile_name (context);
+    }
+
+    fprintf (file, "// Generated by context_profile_fwrite_header, include before ctx.h\n");
+    fprintf (file, "#ifndef CTX_PROFILE_H\n#define CTX_PROFILE_H\n\n");
+
+    for (size_t i = 0; i < CTX_REGISTRY_NAMES && global_profile_names[i].name != NULL; i++) {
+        ContextProfileName* entry = &global_profile_names[i];
+        size_t size               = ctx__profile_recommend (entry->peak, headroom);
+
+        if (strcmp (entry->name, "temp") == 0) {
+            fprintf (file, "#ifndef CTX_TEMP_SIZE\n#define CTX_TEMP_SIZE %zu // peak %zu\n#endif\n", size, entry->peak);
+        } else {
+            fprintf (file, "#define CTX_SIZE_");
+
+            for (const char* c = entry->name; *c != '\0'; c++) {
+                if ((*c >= 'a' && *c <= 'z')) {
+                    fputc (*c - 'a' + 'A', file);
+                } else if ((*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9')) {
+                    fputc (*c, file);
+                } else {
+                    fputc ('_', file);
+                }
+            }
+
+            fprintf (file, " %zu // \"%s\" peak %zu\n", size, entry->name, entry->peak);
+        }
+
+        written++;
+    }
+
+    fprintf (file, "\n// Allocation sites: allocations, bytes, largest, context peak after the allocation\n");
+
+    for (size_t i = 0; i < CTX_PROFILE_SITES; i++) {
+        ContextProfileSite* site = &global_profile_sites[i];
+
+        if (site->allocations == 0) {
+            continue;
+        }
+
+        fprintf (file, "// %s:%d \"%s\" %zu, %zu, %zu, %zu\n", site->file != NULL ? site->file : "(unattributed)", site->line,
+                 site->name, site->allocations, site->bytes, site->largest, site->peak);
+    }
+
+    if (global_profile_dropped > 0) {
+        fprintf (file, "// %zu allocations from sites past CTX_PROFILE_SITES not shown\n", global_profile_dropped);
+    }
+
+    fprintf (file, "\n#endif // CTX_PROFILE_H\n");
+
+    ctx__registry_unlock ();
+
+    return written;
+}
+#endif
+
+#ifdef CTX_ENABLE_STATS
+typedef struct ContextMetricsWriter {
+    char* buffer;
+    size_t capacity;
+    size_t length;
+} ContextMetricsWriter;
+
+// Keeps counting once the buffer is full so the caller learns the size required
+static void ctx__metrics_append (ContextMetricsWriter* writer, const char* fmt, ...) {
+    char scratch[1];
+    char* target     = writer->length < writer->capacity ? writer->buffer + writer->length : scratch;
+    size_t available = writer->length < writer->capacity ? writer->capacity - writer->length : 0;
+
+    va_list args;
+    va_start (args, fmt);
+    int written = vsnprintf (target, available, fmt, args);
+    va_end (args);
+
+    if (written > 0) {
+        writer->length += (size_t)written;
+    }
+}
+
+static void ctx__metrics_label (ContextMetricsWriter* writer, const char* name) {
+    for (; *name != '\0'; name++) {
+        if (*name == '\\' || *name == '"') {
+            ctx__metrics_append (writer, "\\%c", *name);
+        } else if (*name == '\n') {
+            ctx__metrics_append (writer, "\\n");
+        } else {
+            ctx__metrics_append (writer, "%c", *name);
+        }
+    }
+}
+
+static void ctx__metrics_family (ContextMetricsWriter* writer, const ContextUsage* usage, size_t names, const char* metric,
+                                 const char* type, const char* help, size_t offset) {
+    ctx__metrics_append (writer, "# HELP %s %s\n# TYPE %s %s\n", metric, help, metric, type);
+
+    for (size_t i = 0; i < names; i++) {
+        ctx__metrics_append (writer, "%s{name=\"", metric);
+        ctx__metrics_label (writer, usage[i].name);
+        ctx__metrics_append (writer, "\"} %zu\n", *(const size_t*)((const char*)&usage[i] + offset));
+    }
+}
+
+// Prometheus text exposition of every registered context, returns the length required.
+// Allocating threads are never stopped, values are read with relaxed consistency
+size_t context_metrics_write (char* buffer, size_t capacity) {
+    ContextUsage usage[CTX_REGISTRY_NAMES];
+    size_t names = context_registry_report (usage, CTX_REGISTRY_NAMES);
+
+    if (names > CTX_REGISTRY_NAMES) {
+        names = CTX_REGISTRY_NAMES;
+    }
+
+    ContextMetricsWriter writer = {buffer, capacity, 0};
+
+    ctx__metrics_family (&writer, usage, names, "ctx_contexts", "gauge", "Live registered contexts.", offsetof (ContextUsage, contexts));
+    ctx__metrics_family (&writer, usage, names, "ctx_bytes_reserved", "gauge", "Bytes reserved by contexts.", offsetof (ContextUsage, reserved));
+    ctx__metrics_family (&writer, usage, names, "ctx_bytes_committed", "gauge", "Bytes touched since the last decommit.", offsetof (ContextUsage, committed));
+    ctx__metrics_family (&writer, usage, names, "ctx_bytes_used", "gauge", "Bytes currently allocated.", offsetof (ContextUsage, used));
+    ctx__metrics_family (&writer, usage, names, "ctx_bytes_padding", "gauge", "Alignment padding between live allocations.", offsetof (ContextUsage, padding));
+    ctx__metrics_family (&writer, usage, names, "ctx_bytes_peak", "gauge", "Highest allocated bytes.", offsetof (ContextUsage, stats.peak));
+    ctx__metrics_family (&writer, usage, names, "ctx_allocations_total", "counter", "Successful allocations.", offsetof (ContextUsage, stats.allocations));
+    ctx__metrics_family (&writer, usage, names, "ctx_allocated_bytes_total", "counter", "Bytes handed out by allocations.", offsetof (ContextUsage, stats.allocated));
+    ctx__metrics_family (&writer, usage, names, "ctx_allocation_failures_total", "counter", "Allocations that did not fit.", offsetof (ContextUsage, stats.failures));
+
+#ifdef CTX_ENABLE_FAULT_STATS
+    ctx__metrics_family (&writer, usage, names, "ctx_bytes_resident", "gauge", "Bytes resident in memory.", offsetof (ContextUsage, resident));
+    ctx__metrics_family (&writer, usage, names, "ctx_minor_faults_total", "counter", "Minor page faults on first touch.", offsetof (ContextUsage, stats.minor_faults));
+    ctx__metrics_family (&writer, usage, names, "ctx_major_faults_total", "counter", "Major page faults on first touch.", offsetof (ContextUsage, stats.major_faults));
+#endif
+
+#ifdef CTX_ENABLE_TAGS
+    ContextTagUsage tags[CTX_TAGS];
+    size_t count = context_tag_report (tags, CTX_TAGS);
+
+    ctx__metrics_append (&writer, "# HELP ctx_tag_allocated_bytes_total Bytes allocated under each tag.\n"
+                                  "# TYPE ctx_tag_allocated_bytes_total counter\n");
+
+    for (size_t tag = 0; tag < count; tag++) {
+        if (tags[tag].allocations == 0) {
+            continue;
+        }
+
+        ctx__metrics_append (&writer, "ctx_tag_allocated_bytes_total{tag=\"");
+
+        if (tags[tag].name != NULL) {
+            ctx__metrics_label (&writer, tags[tag].name);
+        } else {
+            ctx__metrics_append (&writer, "%zu", tag);
+        }
+
+        ctx__metrics_append (&writer, "\"} %zu\n", tags[tag].bytes);
+    }
+#endif
+
+    if (capacity > 0) {
+        buffer[writer.length < capacity ? writer.length : capacity - 1] = '\0';
+    }
+
+    return writer.length;
+}
+
+size_t context_metrics_fwrite (FILE* file) {
+    char stack_buffer[4096];
+    size_t length = context_metrics_write (stack_buffer, sizeof (stack_buffer));
+
+    if (length < sizeof (stack_buffer)) {
+        return fwrite (stack_buffer, 1, length, file);
+    }
+
+    char* heap_buffer = (char*)CTX_MALLOC (length + 1);
+    if (heap_buffer == NULL) {
+        CTX_LOG ("[ERROR]: Unable to allocate %zu bytes for metrics!\n", length + 1);
+        return 0;
+    }
+
+    // Contexts may have been registered meanwhile, write whatever fits
+    size_t capacity = length + 1;
+    length          = context_metrics_write (heap_buffer, capacity);
+
+    if (length >= capacity) {
+        length = capacity - 1;
+    }
+
+    size_t written = fwrite (heap_buffer, 1, length, file);
+
+    CTX_FREE (heap_buffer);
+
+    return written;
+}
+#endif // CTX_ENABLE_STATS
+#endif // CTX_NO_REGISTRY
+
+#ifdef CTX_ENABLE_PSI
+static int ctx__pressure_read (ContextPressure* monitor);
+
+// A NULL path uses /proc/pressure/memory, threshold is the "some avg10" percentage.
+// Paths ending in memory.events trigger whenever the high or max counters increase.
+// Decommit is not synchronised with allocation, so every listed context (and the temp
+// context) must belong to the thread that polls, EG. poll from each owner's main loop
+ContextPressure new_context_pressure (const char* path, double threshold, Context** contexts, size_t count) {
+    ContextPressure monitor;
+
+    memset (&monitor, 0, sizeof (ContextPressure));
+
+    monitor.path      = path != NULL ? path : "/proc/pressure/memory";
+    monitor.threshold = threshold;
+    monitor.contexts  = contexts;
+    monitor.count     = count;
+
+    // memory.events counts since cgroup creation, only increases past this baseline are pressure
+    ctx__pressure_read (&monitor);
+
+    return monitor;
+}
+
+static int ctx__pressure_read (ContextPressure* monitor) {
+    FILE* file = fopen (monitor->path, "r");
+    if (file == NULL) {
+        CTX_LOG ("[ERROR]: Unable to open pressure file %s!\n", monitor->path);
+        return -1;
+    }
+
+    size_t path_length = strlen (monitor->path);
+    int is_events      = path_length >= 13 && strcmp (monitor->path + path_length - 13, "memory.events") == 0;
+    int pressure       = 0;
+    size_t events      = 0;
+    char line[256];
+
+    while (fgets (line, sizeof (line), file) != NULL) {
+        if (is_events) {
+            size_t value = 0;
+
+            if (sscanf (line, "high %zu", &value) == 1 || sscanf (line, "max %zu", &value) == 1) {
+                events += value;
+            }
+        } else {
+            double average = 0.0;
+
+            if (sscanf (line, "some avg10=%lf", &average) == 1 && average >= monitor->threshold) {
+                pressure = 1;
+            }
+        }
+    }
+
+    fclose (file);
+
+    if (is_events) {
+        pressure        = events > monitor->events;
+        monitor->events = events;
+    }
+
+    return pressure;
+}
+
+// Returns 1 when pressure was detected and handled, 0 when idle and -1 if unreadable.
+// Must run on the thread that owns the listed contexts and the temp context
+int context_pressure_poll (ContextPressure* monitor) {
+    int pressure = ctx__pressure_read (monitor);
+    if (pressure <= 0) {
+        return pressure;
+    }
+
+    for (size_t i = 0; i < monitor->count; i++) {
+        context_decommit (monitor->contexts[i]);
+    }
+
+#ifndef CTX_NO_TEMP
+    context_tdecommit ();
+#endif
+
+    if (monitor->callback != NULL) {
+        monitor->callback (monitor->user);
+    }
+
+    return 1;
+}
+#endif // CTX_ENABLE_PSI
+
+#ifdef CTX_ENABLE_HISTOGRAMS
+const char* context_operation_name (ContextOperation operation) {
+    static const char* names[CTX_OP_COUNT] = {"new", "free", "clear", "decommit", "collect", "failure"};
+
+    return operation < CTX_OP_COUNT ? names[operation] : "unknown";
+}
+
+// Merges every thread's slot, counts keep accumulating while this runs
+void context_histogram_read (ContextOperation operation, ContextHistogram* histogram) {
+    memset (histogram, 0, sizeof (ContextHistogram));
+
+    for (size_t thread = 0; thread < CTX_HISTOGRAM_THREADS; thread++) {
+        size_t* counters = global_histograms[thread][operation];
+
+        for (size_t i = 0; i < CTX_HISTOGRAM_BUCKETS; i++) {
+            histogram->buckets[i] += CTX_ATOMIC_LOAD (&counters[i]);
+        }
+
+        histogram->count += CTX_ATOMIC_LOAD (&counters[CTX_HISTOGRAM_BUCKETS]);
+        histogram->total += CTX_ATOMIC_LOAD (&counters[CTX_HISTOGRAM_BUCKETS + 1]);
+    }
+}
+
+// Upper bound in nanoseconds of the bucket holding the percentile (0.0 - 1.0)
+uint64_t context_histogram_percentile (const ContextHistogram* histogram, double percentile) {
+    size_t total = 0;
+    for (size_t i = 0; i < CTX_HISTOGRAM_BUCKETS; i++) {
+        total += histogram->buckets[i];
+    }
+
+    if (total == 0) {
+        return 0;
+    }
+
+    size_t target = (size_t)(percentile * (double)total + 0.5);
+    size_t seen   = 0;
+
+    if (target == 0) {
+        target = 1;
+    }
+
+    for (size_t i = 0; i < CTX_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+
+        if (seen >= target) {
+            if (i < 16) {
+                return (uint64_t)i;
+            }
+
+            size_t exponent = 4 + (i - 16) / (1 << CTX_HISTOGRAM_SUB_BITS);
+            size_t sub      = (i - 16) % (1 << CTX_HISTOGRAM_SUB_BITS);
+
+            return (((uint64_t)(1 << CTX_HISTOGRAM_SUB_BITS) + sub + 1) << (exponent - CTX_HISTOGRAM_SUB_BITS)) - 1;
+        }
+    }
+
+    return (uint64_t)1 << 40;
+}
+
+void context_histogram_log (void) {
+    CTX_LOG ("[HISTOGRAM]: %-10s %10s %12s %12s %12s %12s\n", "operation", "count", "mean ns", "p50 ns", "p99 ns", "p999 ns");
+
+    for (int operation = 0; operation < CTX_OP_COUNT; operation++) {
+        ContextHistogram histogram;
+        context_histogram_read ((ContextOperation)operation, &histogram);
+
+        if (histogram.count == 0) {
+            continue;
+        }
+
+        CTX_LOG ("[HISTOGRAM]: %-10s %10zu %12llu %12llu %12llu %12llu\n", context_operation_name ((ContextOperation)operation),
+                 histogram.count, (unsigned long long)(histogram.total / histogram.count),
+                 (unsigned long long)context_histogram_percentile (&histogram, 0.5),
+                 (unsigned long long)context_histogram_percentile (&histogram, 0.99),
+                 (unsigned long long)context_histogram_percentile (&histogram, 0.999));
+    }
+}
+#endif // CTX_ENABLE_HISTOGRAMS
+
+#ifdef CTX_ENABLE_TRACE
+// Instant event, EG. the end of a frame or request
+void context_trace_mark (const char* name) {
+    ctx__trace_record (CTX_TRACE_MARK, NULL, name, 0);
+}
+
+// Begin and end must be paired on the same thread
+void context_trace_begin (const char* name) {
+    ctx__trace_record (CTX_TRACE_BEGIN, NULL, name, 0);
 }
 
-#ifndef CTX_NO_STR
-char* context_talloc_cstring (const char* str) {
-    if (global_temp_context.size == 0) {
-        global_temp_context = new_context (CTX_TEMP_SIZE);
+void context_trace_end (const char* name) {
+    ctx__trace_record (CTX_TRACE_END, NULL, name, 0);
+}
+
+void context_trace_reset (void) {
+    CTX_ATOMIC_STORE (&global_trace_head, (size_t)0);
+}
+
+static void ctx__trace_string (FILE* file, const char* str) {
+    fputc ('"', file);
+
+    for (; str != NULL && *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\') {
+            fprintf (file, "\\%c", *str);
+        } else if ((unsigned char)*str < 0x20) {
+            fprintf (file, "\\u%04x", (unsigned char)*str);
+        } else {
+            fputc (*str, file);
+        }
     }
 
-    return context_alloc_cstring (&global_temp_context, str);
+    fputc ('"', file);
 }
 
-char* context_talloc_cstringf (const char* fmt, ...) {
-    if (global_temp_context.size == 0) {
-        global_temp_context = new_context (CTX_TEMP_SIZE);
+// Each context becomes a counter track of its location, clears, frees and failures are
+// instant events and marks/phases are global. Returns the number of events written
+size_t context_trace_fwrite_chrome (FILE* file) {
+    static const char* instants[] = {"alloc", "rewind", "clear", "free", "failure"};
+
+    size_t head    = CTX_ATOMIC_LOAD (&global_trace_head);
+    size_t first   = head > CTX_TRACE_EVENTS ? head - CTX_TRACE_EVENTS : 0;
+    size_t written = 0;
+
+    fprintf (file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    for (size_t sequence = first; sequence < head; sequence++) {
+        ContextTraceEvent event = global_trace_events[sequence % CTX_TRACE_EVENTS];
+
+        if (CTX_ATOMIC_LOAD (&global_trace_events[sequence % CTX_TRACE_EVENTS].sequence) != sequence + 1 || event.sequence != sequence + 1) {
+            continue;
+        }
+
+        fprintf (file, "%s\n{\"pid\":1,\"tid\":%zu,\"ts\":%.3f,", written > 0 ? "," : "", event.thread, (double)event.timestamp / 1000.0);
+
+        switch (event.type) {
+            case CTX_TRACE_ALLOC:
+            case CTX_TRACE_REWIND:
+            case CTX_TRACE_CLEAR:
+            case CTX_TRACE_FREE:
+                fprintf (file, "\"ph\":\"C\",\"name\":");
+                ctx__trace_string (file, event.name != NULL ? event.name : "context");
+                fprintf (file, ",\"id\":\"%p\",\"args\":{\"location\":%zu}}", event.context, event.value);
+
+                if (event.type != CTX_TRACE_CLEAR && event.type != CTX_TRACE_FREE) {
+                    break;
+                }
+
+                written++;
+                fprintf (file, ",\n{\"pid\":1,\"tid\":%zu,\"ts\":%.3f,", event.thread, (double)event.timestamp / 1000.0);
+                // fall through
+            case CTX_TRACE_FAILURE:
+                fprintf (file, "\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\",\"args\":{\"context\":", instants[event.type]);
+                ctx__trace_string (file, event.name != NULL ? event.name : "context");
+                fprintf (file, ",\"id\":\"%p\",\"bytes\":%zu}}", event.context, event.value);
+                break;
+            case CTX_TRACE_MARK:
+                fprintf (file, "\"ph\":\"i\",\"s\":\"g\",\"name\":");
+                ctx__trace_string (file, event.name);
+                fprintf (file, "}");
+                break;
+            case CTX_TRACE_BEGIN:
+            case CTX_TRACE_END:
+                fprintf (file, "\"ph\":\"%s\",\"name\":", event.type == CTX_TRACE_BEGIN ? "B" : "E");
+                ctx__trace_string (file, event.name);
+                fprintf (file, "}");
+                break;
+        }
+
+        written++;
     }
 
-    va_list args;
-    va_start (args, fmt);
+    fprintf (file, "\n]}\n");
 
-    va_list args_copy;
-    va_copy (args_copy, args);
-    size_t string_length = vsnprintf (NULL, 0, fmt, args_copy) + 1;
-    va_end (args_copy);
+    return written;
+}
+#endif // CTX_ENABLE_TRACE
 
-    char* buffer = context_alloc (&global_temp_context, string_length);
-    if (buffer == NULL) {
-        va_end (args);
+#ifndef CTX_NO_HANDLES
+#define CTX_HANDLE_NONE UINT32_MAX
+
+// Slots live in storage, objects in context. Storage must outlive every handle
+ContextHandleTable context_handle_table (Context* storage, Context* context, uint32_t capacity) {
+    ContextHandleTable table;
+
+    table.context   = context;
+    table.slots     = (ContextHandleSlot*)context_alloc_array (storage, sizeof (ContextHandleSlot), capacity, CTX_ALIGNOF (ContextHandleSlot));
+    table.capacity  = table.slots != NULL ? capacity : 0;
+    table.count     = 0;
+    table.free_list = CTX_HANDLE_NONE;
+
+    return table;
+}
+
+ContextHandle context_handle_create (ContextHandleTable* table, void* object) {
+    ContextHandle handle = {0, 0};
+    uint32_t index;
+
+    if (object == NULL) {
+        return handle;
+    }
+
+    if (table->free_list != CTX_HANDLE_NONE) {
+        index            = table->free_list;
+        table->free_list = table->slots[index].context_generation;
+    } else if (table->count < table->capacity) {
+        index                          = table->count++;
+        table->slots[index].generation = 0;
+    } else {
+        CTX_LOG ("[ERROR]: Handle table is full (%u slots)!\n", table->capacity);
+        return handle;
+    }
+
+    ContextHandleSlot* slot  = &table->slots[index];
+    slot->object             = object;
+    slot->context_generation = table->context->generation;
+
+    // Skip 0 on wrap around so released handles never become valid again
+    if (++slot->generation == 0) {
+        slot->generation = 1;
+    }
+
+    handle.index      = index;
+    handle.generation = slot->generation;
+
+    return handle;
+}
+
+// Live while every rewind since the slot's generation stopped above the object. Objects outside
+// the buffer, and generations older than the remembered rewinds, go stale on any rewind
+static int ctx__handle_live (const Context* context, uint32_t generation, const void* object) {
+    uint32_t age = context->generation - generation;
+    if (age == 0) {
+        return 1;
+    }
+
+    uintptr_t start = (uintptr_t)context->buffer;
+    if (context->buffer == NULL || (uintptr_t)object < start || (uintptr_t)object - start >= context->size) {
+        return 0;
+    }
+
+    // Unsigned distances keep the comparisons correct across generation wrap around
+    if ((uint32_t)(context->rewind_lost - generation - 1) < age) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < context->rewind_count; i++) {
+        if ((uint32_t)(context->rewind_generations[i] - generation - 1) < age) {
+            return context->rewinds[i] > (size_t)((uintptr_t)object - start);
+        }
+    }
+
+    return 0;
+}
+
+// NULL for released handles and for objects that a clear or rewind has reclaimed
+void* context_handle_get (const ContextHandleTable* table, ContextHandle handle) {
+    if (handle.index >= table->count) {
         return NULL;
     }
 
-    vsnprintf (buffer, string_length, fmt, args);
-    va_end (args);
+    const ContextHandleSlot* slot = &table->slots[handle.index];
+    if (slot->generation != handle.generation || slot->object == NULL ||
+        !ctx__handle_live (table->context, slot->context_generation, slot->object)) {
+        return NULL;
+    }
 
-    return buffer;
+    return slot->object;
 }
-#endif
 
-void context_tclear (void) {
-    context_clear (&global_temp_context);
+int context_handle_relocate (ContextHandleTable* table, ContextHandle handle, void* object) {
+    if (object == NULL || handle.index >= table->count || table->slots[handle.index].generation != handle.generation) {
+        return 0;
+    }
+
+    table->slots[handle.index].object             = object;
+    table->slots[handle.index].context_generation = table->context->generation;
+
+    return 1;
 }
 
-void context_tfree (void) {
-    context_free (&global_temp_context);
+// Moves every live handle to a new context, use after compaction has updated the slot objects
+void context_handle_retarget (ContextHandleTable* table, Context* context) {
+    table->context = context;
+
+    for (uint32_t i = 0; i < table->count; i++) {
+        if (table->slots[i].object != NULL) {
+            table->slots[i].context_generation = context->generation;
+        }
+    }
 }
-#endif // CTX_NO_TEMP
+
+void context_handle_release (ContextHandleTable* table, ContextHandle handle) {
+    if (handle.index >= table->count || table->slots[handle.index].generation != handle.generation) {
+        return;
+    }
+
+    ContextHandleSlot* slot  = &table->slots[handle.index];
+    slot->object             = NULL;
+    slot->context_generation = table->free_list;
+
+    if (++slot->generation == 0) {
+        slot->generation = 1;
+    }
+
+    table->free_list = handle.index;
+}
+#endif // CTX_NO_HANDLES
+
+#ifndef CTX_NO_BTREE
+static ContextBTreeNode* ctx__btree_node (Context* context, uint32_t leaf) {
+    ContextBTreeNode* node = (ContextBTreeNode*)context_alloc_aligned (context, sizeof (ContextBTreeNode), CTX_CACHE_LINE);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    node->count = 0;
+    node->leaf  = leaf;
+    node->next  = NULL;
+
+    return node;
+}
+
+// Index of the first key greater than key
+static uint32_t ctx__btree_upper (const ContextBTreeNode* node, uint64_t key) {
+    uint32_t low  = 0;
+    uint32_t high = node->count;
+
+    while (low < high) {
+        uint32_t middle = (low + high) / 2;
+
+        if (node->keys[middle] <= key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static const ContextBTreeNode* ctx__btree_leaf (const ContextBTree* tree, uint64_t key) {
+    const ContextBTreeNode* node = tree->root;
+
+    while (node != NULL && !node->leaf) {
+        uint32_t child = ctx__btree_upper (node, key);
+        node           = (const ContextBTreeNode*)node->slots[child > 0 ? child - 1 : 0];
+    }
+
+    return node;
+}
+
+static void ctx__btree_place (ContextBTreeNode* node, uint32_t index, uint64_t key, void* slot) {
+    memmove (&node->keys[index + 1], &node->keys[index], (node->count - index) * sizeof (uint64_t));
+    memmove (&node->slots[index + 1], &node->slots[index], (node->count - index) * sizeof (void*));
+
+    node->keys[index]  = key;
+    node->slots[index] = slot;
+    node->count++;
+}
+
+ContextBTree context_btree (Context* context) {
+    ContextBTree tree;
+
+    tree.context = context;
+    tree.root    = NULL;
+    tree.count   = 0;
+    tree.height  = 0;
+
+    return tree;
+}
+
+int context_btree_insert (ContextBTree* tree, uint64_t key, void* value) {
+    ContextBTreeNode* path[CTX_BTREE_MAX_HEIGHT];
+    uint32_t indices[CTX_BTREE_MAX_HEIGHT];
+    ContextBTreeNode* spare[CTX_BTREE_MAX_HEIGHT + 1];
+    size_t location = tree->context->location;
+
+    if (tree->root == NULL) {
+        tree->root = ctx__btree_node (tree->context, 1);
+        if (tree->root == NULL) {
+            return 0;
+        }
+
+        tree->height = 1;
+    }
+
+    ContextBTreeNode* node = tree->root;
+    size_t level           = 0;
+
+    for (; !node->leaf; level++) {
+        uint32_t child = ctx__btree_upper (node, key);
+
+        path[level]    = node;
+        indices[level] = child > 0 ? child - 1 : 0;
+        node           = (ContextBTreeNode*)node->slots[indices[level]];
+    }
+
+    uint32_t index = ctx__btree_upper (node, key);
+    path[level]    = node;
+
+    if (index > 0 && node->keys[index - 1] == key) {
+        node->slots[index - 1] = value;
+        return 1;
+    }
+
+    // Every full node on the way up splits, allocate them all before touching the tree
+    size_t splits = 0;
+
+    while (splits <= level && path[level - splits]->count == CTX_BTREE_KEYS) {
+        splits++;
+    }
+
+    for (size_t i = 0; i < splits + (splits > level ? 1 : 0); i++) {
+        spare[i] = ctx__btree_node (tree->context, i == 0);
+
+        if (spare[i] == NULL) {
+            context_rewind (tree->context, location);
+            return 0;
+        }
+    }
+
+    uint64_t entry_key = key;
+    void* entry_slot   = value;
+
+    for (size_t i = 0;; i++) {
+        node = path[level - i];
+
+        if (i > 0) {
+            index = indices[level - i] + 1;
+        }
+
+        if (node->count < CTX_BTREE_KEYS) {
+            ctx__btree_place (node, index, entry_key, entry_slot);
+            break;
+        }
+
+        ContextBTreeNode* right = spare[i];
+        uint32_t half           = (uint32_t)(CTX_BTREE_KEYS + 1) / 2;
+
+        right->leaf  = node->leaf;
+        right->count = node->count - half;
+        right->next  = node->next;
+        memcpy (right->keys, &node->keys[half], right->count * sizeof (uint64_t));
+        memcpy (right->slots, &node->slots[half], right->count * sizeof (void*));
+
+        node->count = half;
+        node->next  = right;
+
+        if (index <= half) {
+            ctx__btree_place (node, index, entry_key, entry_slot);
+        } else {
+            ctx__btree_place (right, index - half, entry_key, entry_slot);
+        }
+
+        entry_key  = right->keys[0];
+        entry_slot = right;
+
+        if (i == level) {
+            ContextBTreeNode* root = spare[i + 1];
+
+            root->leaf     = 0;
+            root->count    = 2;
+            root->keys[0]  = node->keys[0];
+            root->slots[0] = node;
+            root->keys[1]  = right->keys[0];
+            root->slots[1] = right;
+
+            tree->root = root;
+            tree->height++;
+            break;
+        }
+    }
+
+    tree->count++;
+
+    return 1;
+}
+
+// Packs sorted, unique keys into full leaves and builds each level above from the one below
+int context_btree_bulk_load (ContextBTree* tree, const uint64_t* keys, void* const* values, size_t count) {
+    if (tree->root != NULL) {
+        CTX_LOG ("[ERROR]: Bulk load needs an empty B+tree!\n");
+        return 0;
+    }
+
+    for (size_t i = 1; i < count; i++) {
+        if (keys[i - 1] >= keys[i]) {
+            CTX_LOG ("[ERROR]: Bulk load keys are not sorted and unique at %zu!\n", i);
+            return 0;
+        }
+    }
+
+    if (count == 0) {
+        return 1;
+    }
+
+    size_t location            = tree->context->location;
+    ContextBTreeNode* level    = NULL;
+    size_t nodes               = (count + CTX_BTREE_KEYS - 1) / CTX_BTREE_KEYS;
+    size_t height              = 1;
+    size_t remaining           = count;
+    ContextBTreeNode** sibling = &level;
+
+    // Spreading the remainder keeps the last node from being nearly empty
+    for (size_t node_index = 0, item = 0; node_index < nodes; node_index++) {
+        ContextBTreeNode* node = ctx__btree_node (tree->context, 1);
+        if (node == NULL) {
+            context_rewind (tree->context, location);
+            return 0;
+        }
+
+        uint32_t fill = (uint32_t)(remaining / (nodes - node_index));
+        memcpy (node->keys, &keys[item], fill * sizeof (uint64_t));
+
+        if (values != NULL) {
+            memcpy (node->slots, &values[item], fill * sizeof (void*));
+        } else {
+            memset (node->slots, 0, fill * sizeof (void*));
+        }
+
+        node->count = fill;
+        item += fill;
+        remaining -= fill;
+
+        *sibling = node;
+        sibling  = &node->next;
+    }
+
+    while (nodes > 1) {
+        ContextBTreeNode* child = level;
+        size_t parents          = (nodes + CTX_BTREE_KEYS - 1) / CTX_BTREE_KEYS;
+
+        remaining = nodes;
+        level     = NULL;
+        sibling   = &level;
+
+        for (size_t parent_index = 0; parent_index < parents; parent_index++) {
+            ContextBTreeNode* node = ctx__btree_node (tree->context, 0);
+            if (node == NULL) {
+                context_rewind (tree->context, location);
+                return 0;
+            }
+
+            uint32_t fill = (uint32_t)(remaining / (parents - parent_index));
+
+            for (uint32_t i = 0; i < fill; i++, child = child->next) {
+                node->keys[i]  = child->keys[0];
+                node->slots[i] = child;
+            }
+
+            node->count = fill;
+            remaining -= fill;
+
+            *sibling = node;
+            sibling  = &node->next;
+        }
+
+        nodes = parents;
+        height++;
+    }
+
+    tree->root   = level;
+    tree->count  = count;
+    tree->height = height;
+
+    return 1;
+}
+
+void** context_btree_find (const ContextBTree* tree, uint64_t key) {
+    const ContextBTreeNode* leaf = ctx__btree_leaf (tree, key);
+    if (leaf == NULL) {
+        return NULL;
+    }
+
+    uint32_t index = ctx__btree_upper (leaf, key);
+
+    if (index == 0 || leaf->keys[index - 1] != key) {
+        return NULL;
+    }
+
+    return (void**)&leaf->slots[index - 1];
+}
+
+// Positions the cursor on the first key not less than key
+ContextBTreeCursor context_btree_seek (const ContextBTree* tree, uint64_t key) {
+    ContextBTreeCursor cursor;
+
+    cursor.leaf  = ctx__btree_leaf (tree, key);
+    cursor.index = 0;
+
+    if (cursor.leaf != NULL) {
+        cursor.index = ctx__btree_upper (cursor.leaf, key);
+
+        if (cursor.index > 0 && cursor.leaf->keys[cursor.index - 1] == key) {
+            cursor.index--;
+        }
+    }
+
+    return cursor;
+}
+
+int context_btree_next (ContextBTreeCursor* cursor, uint64_t* key, void** value) {
+    while (cursor->leaf != NULL && cursor->index >= cursor->leaf->count) {
+        cursor->leaf  = cursor->leaf->next;
+        cursor->index = 0;
+    }
+
+    if (cursor->leaf == NULL) {
+        return 0;
+    }
+
+    if (key != NULL) {
+        *key = cursor->leaf->keys[cursor->index];
+    }
+
+    if (value != NULL) {
+        *value = cursor->leaf->slots[cursor->index];
+    }
+
+    cursor->index++;
+
+    return 1;
+}
+#endif // CTX_NO_BTREE
+
+#ifndef CTX_NO_SKIPLIST
+static ContextSkipNode* ctx__skiplist_node (Context* context, size_t height) {
+    size_t size           = offsetof (ContextSkipNode, next) + height * sizeof (ContextSkipNode*);
+    ContextSkipNode* node = (ContextSkipNode*)context_alloc_atomic (context, size, CTX_ALIGNOF (ContextSkipNode));
+
+    if (node != NULL) {
+        node->height = height;
+    }
+
+    return node;
+}
+
+// Each level is a quarter as likely as the one below it
+static size_t ctx__skiplist_height (void) {
+    if (global_skiplist_seed == 0) {
+        global_skiplist_seed = (uint64_t)(uintptr_t)&global_skiplist_seed | 1;
+    }
+
+    global_skiplist_seed ^= global_skiplist_seed << 13;
+    global_skiplist_seed ^= global_skiplist_seed >> 7;
+    global_skiplist_seed ^= global_skiplist_seed << 17;
+
+    size_t height = 1;
+    uint64_t bits = global_skiplist_seed;
+
+    while (height < CTX_SKIPLIST_HEIGHT && (bits & 3) == 0) {
+        height++;
+        bits >>= 2;
+    }
+
+    return height;
+}
+
+// Fills the last node before key and the first node at or after it on every level
+static void ctx__skiplist_search (const ContextSkipList* list, uint64_t key, ContextSkipNode** before, ContextSkipNode** after) {
+    ContextSkipNode* node = list->head;
+
+    for (size_t level = CTX_SKIPLIST_HEIGHT; level-- > 0;) {
+        ContextSkipNode* next = (ContextSkipNode*)CTX_ATOMIC_LOAD (&node->next[level]);
+
+        while (next != NULL && next->key < key) {
+            node = next;
+            next = (ContextSkipNode*)CTX_ATOMIC_LOAD (&node->next[level]);
+        }
+
+        before[level] = node;
+        after[level]  = next;
+    }
+}
+
+ContextSkipList context_skiplist (Context* context) {
+    ContextSkipList list;
+
+    list.context = context;
+    list.count   = 0;
+    list.head    = ctx__skiplist_node (context, CTX_SKIPLIST_HEIGHT);
+
+    if (list.head != NULL) {
+        list.head->key   = 0;
+        list.head->value = NULL;
+        memset (list.head->next, 0, CTX_SKIPLIST_HEIGHT * sizeof (ContextSkipNode*));
+    }
+
+    return list;
+}
+
+// Safe to call from many threads at once, an existing key has its value replaced
+int context_skiplist_insert (ContextSkipList* list, uint64_t key, void* value) {
+    ContextSkipNode* before[CTX_SKIPLIST_HEIGHT];
+    ContextSkipNode* after[CTX_SKIPLIST_HEIGHT];
+    ContextSkipNode* node = NULL;
+
+    for (;;) {
+        ctx__skiplist_search (list, key, before, after);
+
+        if (after[0] != NULL && after[0]->key == key) {
+            CTX_ATOMIC_STORE (&after[0]->value, value);
+            return 1;
+        }
+
+        // A node left over from a lost race is reused rather than allocated again
+        if (node == NULL) {
+            node = ctx__skiplist_node (list->context, ctx__skiplist_height ());
+            if (node == NULL) {
+                return 0;
+            }
+
+            node->key   = key;
+            node->value = value;
+        }
+
+        for (size_t level = 0; level < node->height; level++) {
+            node->next[level] = after[level];
+        }
+
+        // Linking the bottom level is what inserts the key, the levels above only speed up searches
+        if (CTX_ATOMIC_CAS (&before[0]->next[0], after[0], node)) {
+            break;
+        }
+    }
+
+    for (size_t level = 1; level < node->height; level++) {
+        while (!CTX_ATOMIC_CAS (&before[level]->next[level], after[level], node)) {
+            ctx__skiplist_search (list, key, before, after);
+            CTX_ATOMIC_STORE (&node->next[level], after[level]);
+        }
+    }
+
+    CTX_ATOMIC_FETCH_ADD (&list->count, (size_t)1);
+
+    return 1;
+}
+
+int context_skiplist_find (const ContextSkipList* list, uint64_t key, void** value) {
+    ContextSkipNode* before[CTX_SKIPLIST_HEIGHT];
+    ContextSkipNode* after[CTX_SKIPLIST_HEIGHT];
+
+    ctx__skiplist_search (list, key, before, after);
+
+    if (after[0] == NULL || after[0]->key != key) {
+        return 0;
+    }
+
+    if (value != NULL) {
+        *value = (void*)CTX_ATOMIC_LOAD (&after[0]->value);
+    }
+
+    return 1;
+}
+
+// Positions the cursor on the first key not less than key, keys inserted meanwhile may be seen
+ContextSkipCursor context_skiplist_seek (const ContextSkipList* list, uint64_t key) {
+    ContextSkipNode* before[CTX_SKIPLIST_HEIGHT];
+    ContextSkipNode* after[CTX_SKIPLIST_HEIGHT];
+    ContextSkipCursor cursor;
+
+    ctx__skiplist_search (list, key, before, after);
+    cursor.node = after[0];
+
+    return cursor;
+}
+
+int context_skiplist_next (ContextSkipCursor* cursor, uint64_t* key, void** value) {
+    const ContextSkipNode* node = cursor->node;
+    if (node == NULL) {
+        return 0;
+    }
+
+    if (key != NULL) {
+        *key = node->key;
+    }
+
+    if (value != NULL) {
+        *value = (void*)CTX_ATOMIC_LOAD (&node->value);
+    }
+
+    cursor->node = (const ContextSkipNode*)CTX_ATOMIC_LOAD (&node->next[0]);
+
+    return 1;
+}
+#endif // CTX_NO_SKIPLIST
 
 #ifdef __cplusplus
 }
@@ -346,4 +4106,21 @@ void context_tfree (void) {
 
 #endif
 
+// Placed after the implementation so only calls from user code record their file and line
+#ifdef CTX_ENABLE_PROFILE
+#define context_alloc(...)           (context_profile_site (__FILE__, __LINE__), context_alloc (__VA_ARGS__))
+#define context_alloc_aligned(...)   (context_profile_site (__FILE__, __LINE__), context_alloc_aligned (__VA_ARGS__))
+#define context_alloc_array(...)     (context_profile_site (__FILE__, __LINE__), context_alloc_array (__VA_ARGS__))
+#define context_alloc_zeroed(...)    (context_profile_site (__FILE__, __LINE__), context_alloc_zeroed (__VA_ARGS__))
+#define context_alloc_cstring(...)   (context_profile_site (__FILE__, __LINE__), context_alloc_cstring (__VA_ARGS__))
+#define context_alloc_cstringf(...)  (context_profile_site (__FILE__, __LINE__), context_alloc_cstringf (__VA_ARGS__))
+#define context_talloc(...)          (context_profile_site (__FILE__, __LINE__), context_talloc (__VA_ARGS__))
+#define context_talloc_cstring(...)  (context_profile_site (__FILE__, __LINE__), context_talloc_cstring (__VA_ARGS__))
+#define context_talloc_cstringf(...) (context_profile_site (__FILE__, __LINE__), context_talloc_cstringf (__VA_ARGS__))
+#define context_alloc_tagged(...)    (context_profile_site (__FILE__, __LINE__), context_alloc_tagged (__VA_ARGS__))
+#define context_talloc_tagged(...)   (context_profile_site (__FILE__, __LINE__), context_talloc_tagged (__VA_ARGS__))
+#define ctx__alloc(...)              (context_profile_site (__FILE__, __LINE__), ctx__alloc (__VA_ARGS__))
+#define ctx__alloc_array(...)        (context_profile_site (__FILE__, __LINE__), ctx__alloc_array (__VA_ARGS__))
+#endif
+
 #endif // CTX_H